@@ -1,28 +1,68 @@
 #include "arguments.h"
 
 #include <boost/program_options.hpp>
+#include <boost/format.hpp>
 
 #include <iostream>
 
 
+namespace
+{
+   knossos::storage_type_t storage_from_string(std::string const & name)
+   {
+      if (name == "tree")
+         return knossos::storage_tree;
+      if (name == "hash")
+         return knossos::storage_hash;
+      if (name == "bitmap")
+         return knossos::storage_bitmap;
+      if (name == "compact")
+         return knossos::storage_compact;
+      if (name == "versioned")
+         return knossos::storage_versioned;
+
+      boost::format error("unknown storage type: %1%");
+      throw std::runtime_error(str(error % name));
+   }
+}
+
+
 boost::optional<arguments_t> parse_arguments( int argc, char * argv[] )
 {
    namespace po = boost::program_options;
    po::options_description descr("Program options");
 
    arguments_t parsed;
+   std::string storage;
+   std::string stats;
    descr.add_options()
       ("help,h"  , "display this help and exit")
       ("board"   , po::value<std::string>(&parsed.board_path)->required(),
          "specify path to file with labyrinth")
-      ("route"   , po::value<std::string>(&parsed.route)->required(),
+      ("route"   , po::value<std::string>(&parsed.route),
          "describe route in format /[dlru]+/")
+      ("route-file", po::value<std::string>(&parsed.route_file),
+         "read route from specified file ('-' - from stdin) instead of --route")
       ("x,x"     , po::value<int>(&parsed.x0)->default_value(0),
          "start position x-coordinate")
       ("y,y"     , po::value<int>(&parsed.y0)->default_value(0),
          "start position y-coordinate")
       ("output,o", po::value<std::string>(&parsed.output_path),
          "output result to specified file (instead of stdout)")
+      ("storage" , po::value<std::string>(&storage)->default_value("tree"),
+         "sections storage: tree, hash, bitmap, compact, versioned")
+      ("threads" , po::value<unsigned>(&parsed.threads)->default_value(0),
+         "threads used to build labyrinth and to serve connections (0 - all cores)")
+      ("rle"     , po::bool_switch(&parsed.rle),
+         "route is run-length encoded: /([dlru][0-9]*)+/, e.g. r120u7l")
+      ("convert" , po::value<std::string>(&parsed.convert_path),
+         "save board to specified file in binary format and exit")
+      ("serve"   , po::bool_switch(&parsed.serve),
+         "answer queries \"x, y, route\" from stdin, one per line, until end of input")
+      ("socket"  , po::value<std::string>(&parsed.socket_path),
+         "answer queries from connections to specified local socket until SIGINT/SIGTERM")
+      ("stats"   , po::value<std::string>(&stats)->implicit_value("text"),
+         "print counters and time of phases to stderr: text (default) or json")
       ;
 
    auto print_usage = [&descr]
@@ -42,6 +82,22 @@ boost::optional<arguments_t> parse_arguments( int argc, char * argv[] )
          return boost::none;
       }
       po::notify(vm);
+      if (!vm.count("route") && parsed.route_file.empty() && parsed.convert_path.empty()
+          && !parsed.serve && parsed.socket_path.empty())
+         throw po::required_option("route");
+      if (vm.count("route") && !parsed.route_file.empty())
+         throw std::runtime_error("options '--route' and '--route-file' are mutually exclusive");
+      parsed.storage = storage_from_string(storage);
+      if (vm.count("stats"))
+      {
+         if (stats != "text" && stats != "json")
+         {
+            boost::format error("unknown statistics format: %1%");
+            throw std::runtime_error(str(error % stats));
+         }
+         parsed.stats = true;
+         parsed.stats_json = stats == "json";
+      }
    }
    catch (...)
    {
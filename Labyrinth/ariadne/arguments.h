@@ -1,14 +1,24 @@
 #pragma once
 
+#include <knossos/labyrinth.h>
 #include <boost/optional.hpp>
 
 struct arguments_t
 {
    std::string board_path;
    std::string route;
+   std::string route_file;
    int         x0 = 0;
    int         y0 = 0;
    std::string output_path;
+   knossos::storage_type_t storage = knossos::storage_tree;
+   unsigned    threads = 0;
+   bool        rle = false;
+   std::string convert_path;
+   bool        serve = false;
+   std::string socket_path;
+   bool        stats = false;
+   bool        stats_json = false;
 };
 
 boost::optional<arguments_t> parse_arguments( int argc, char * argv[] );
@@ -0,0 +1,99 @@
+#include "board_binary.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+namespace fs  = boost::filesystem;
+namespace bip = boost::interprocess;
+
+static_assert(sizeof(knossos::position_t) == 2 * sizeof(std::int32_t),
+              "position_t must match the binary board layout");
+
+namespace
+{
+   [[ noreturn ]] void throw_invalid(fs::path const & path, std::string const & reason)
+   {
+      boost::format error("%1%: invalid binary board, %2%");
+      throw std::runtime_error(str(error % path.filename().string() % reason));
+   }
+}
+
+bool is_binary_board(fs::path const & path)
+{
+   std::ifstream file(path.string().c_str(), std::ios::binary);
+   char magic[sizeof(board_magic)] = {};
+   file.read(magic, sizeof(magic));
+   return file && std::memcmp(magic, board_magic, sizeof(magic)) == 0;
+}
+
+void load_sections_binary(fs::path const & path,
+                          sections_sink_t const & sink, std::size_t chunk_size)
+{
+   bip::file_mapping file(path.string().c_str(), bip::read_only);
+   auto const size = fs::file_size(path);
+   if (size < sizeof(board_header_t))
+      throw_invalid(path, "truncated header");
+
+   board_header_t header;
+   {
+      bip::mapped_region region(file, bip::read_only, 0, sizeof(header));
+      std::memcpy(&header, region.get_address(), sizeof(header));
+   }
+   if (header.byte_order != board_byte_order)
+      throw_invalid(path, "unsupported byte order");
+   if (header.version != board_version)
+      throw_invalid(path, "unsupported version");
+   if (header.count != (size - sizeof(header)) / sizeof(knossos::position_t)
+       || (size - sizeof(header)) % sizeof(knossos::position_t) != 0)
+      throw_invalid(path, "size does not match the number of sections");
+
+   // Порция за порцией отображается своё окно файла: прочитанные
+   // страницы освобождаются сразу, а не держатся до конца загрузки
+   std::vector<knossos::position_t> chunk;
+   std::uint64_t done = 0;
+   do
+   {
+      auto const count = std::size_t(std::min<std::uint64_t>(chunk_size, header.count - done));
+      chunk.clear();
+      if (count != 0)
+      {
+         auto const bytes = count * sizeof(knossos::position_t);
+         bip::mapped_region window(file, bip::read_only,
+                                   bip::offset_t(sizeof(header) + done * sizeof(knossos::position_t)),
+                                   bytes);
+         auto const first = static_cast<knossos::position_t const *>(window.get_address());
+         chunk.assign(first, first + count);
+      }
+      done += count;
+      sink(chunk, header.count);
+   }
+   while (done != header.count);
+}
+
+void save_sections_binary(fs::path const & path,
+                          std::vector<knossos::position_t> const & sections)
+{
+   board_header_t header;
+   std::memcpy(header.magic, board_magic, sizeof(board_magic));
+   header.byte_order = board_byte_order;
+   header.version    = board_version;
+   header.count      = sections.size();
+
+   std::ofstream file(path.string().c_str(), std::ios::binary);
+   file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+   file.write(reinterpret_cast<char const *>(sections.data()),
+              std::streamsize(sections.size() * sizeof(knossos::position_t)));
+   if (!file)
+   {
+      boost::format error("failed to write file '%1%'");
+      throw std::runtime_error(str(error % path));
+   }
+}
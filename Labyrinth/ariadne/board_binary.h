@@ -0,0 +1,37 @@
+#pragma once
+
+#include "load_sections.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/*!
+ * \brief Заголовок двоичного файла лабиринта
+ *
+ * За заголовком следуют count пар int32 (x, y) в порядке байтов
+ * записавшей машины - та же раскладка, что у массива position_t,
+ * поэтому отображённый в память файл читается без разбора.
+ */
+struct board_header_t
+{
+   char          magic[8];    ///< board_magic
+   std::uint32_t byte_order;  ///< board_byte_order, записанный как есть
+   std::uint32_t version;     ///< board_version
+   std::uint64_t count;       ///< количество секций
+};
+
+char const          board_magic[8]   = {'K', 'N', 'O', 'S', 'S', 'O', 'S', 'B'};
+std::uint32_t const board_byte_order = 0x01020304;
+std::uint32_t const board_version    = 1;
+
+/// Начинается ли файл с заголовка двоичного формата
+bool is_binary_board(boost::filesystem::path const & path);
+
+/// Секции из двоичного файла, отображённого в память, порциями (см. load_sections)
+void load_sections_binary(boost::filesystem::path const & path,
+                          sections_sink_t const & sink, std::size_t chunk_size);
+
+/// Запись секций в двоичном формате
+void save_sections_binary(boost::filesystem::path const & path,
+                          std::vector<knossos::position_t> const & sections);
@@ -0,0 +1,180 @@
+#include "build_labyrinth.h"
+#include "load_sections.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+namespace fs = boost::filesystem;
+namespace
+{
+   /// Секций в порции: достаточно, чтобы пакетное добавление окупалось
+   std::size_t const chunk_size = 1 << 16;
+
+   /// Порций, разобранных впрок
+   std::size_t const queue_capacity = 4;
+
+   typedef std::vector<knossos::position_t> chunk_t;
+
+   /*!
+    * \brief Очередь порций от разбора к построению
+    *
+    * Векторы обмениваются, а не копируются, и после добавления
+    * возвращаются разбору, так что память под порции выделяется один раз
+    */
+   class chunk_queue_t
+   {
+   public:
+      /// Отдаёт порцию, взамен chunk получает свободный вектор.
+      /// false, если построение прервано
+      bool push(chunk_t & chunk, std::uint64_t expected)
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         if (expected_ == 0)
+            expected_ = expected;
+         changed_.wait(lock, [this] { return ready_.size() < queue_capacity || cancelled_; });
+         if (cancelled_)
+            return false;
+
+         ready_.push_back(std::move(chunk));
+         chunk.clear();
+         if (!free_.empty())
+         {
+            chunk.swap(free_.back());
+            free_.pop_back();
+         }
+         changed_.notify_all();
+         return true;
+      }
+
+      /// Следующая порция в chunk, прежняя возвращается разбору.
+      /// false, если порций больше нет; ошибка разбора кидается здесь
+      bool pop(chunk_t & chunk)
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         if (chunk.capacity() != 0)
+         {
+            chunk.clear();
+            free_.push_back(std::move(chunk));
+            chunk = chunk_t();
+         }
+
+         changed_.wait(lock, [this] { return !ready_.empty() || closed_; });
+         if (!ready_.empty())
+         {
+            chunk.swap(ready_.front());
+            ready_.pop_front();
+            changed_.notify_all();
+            return true;
+         }
+
+         if (error_)
+            std::rethrow_exception(error_);
+         return false;
+      }
+
+      /// Ожидаемое число секций по первой порции, см. sections_sink_t
+      std::uint64_t expected()
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         return expected_;
+      }
+
+      /// Разбор закончен, error - его ошибка, если была
+      void close(std::exception_ptr error = nullptr)
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         closed_ = true;
+         error_  = error;
+         changed_.notify_all();
+      }
+
+      /// Построение прервано, разбор должен остановиться
+      void cancel()
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         cancelled_ = true;
+         changed_.notify_all();
+      }
+
+   private:
+      std::mutex              mutex_;
+      std::condition_variable changed_;
+      std::deque<chunk_t>     ready_;
+      std::vector<chunk_t>    free_;
+      std::exception_ptr      error_;
+      std::uint64_t           expected_  = 0;
+      bool                    closed_    = false;
+      bool                    cancelled_ = false;
+   };
+
+   struct cancelled_t {};
+
+   typedef std::chrono::steady_clock steady_clock_t;
+
+   double seconds(steady_clock_t::duration duration)
+   {
+      return std::chrono::duration<double>(duration).count();
+   }
+}
+
+double build_labyrinth(fs::path const & path, knossos::labyrinth_t & lab, unsigned num_threads)
+{
+   chunk_queue_t queue;
+   steady_clock_t::duration parse_time{};
+   std::thread parser([&]
+   {
+      try
+      {
+         // Время ожидания места в очереди - это время построения, а не разбора
+         auto const start = steady_clock_t::now();
+         steady_clock_t::duration waiting{};
+         load_sections(path, [&queue, &waiting](chunk_t & chunk, std::uint64_t expected)
+         {
+            auto const push_start = steady_clock_t::now();
+            if (!chunk.empty() && !queue.push(chunk, expected))
+               throw cancelled_t();
+            waiting += steady_clock_t::now() - push_start;
+         }, chunk_size);
+         parse_time = steady_clock_t::now() - start - waiting;
+         queue.close();
+      }
+      catch (cancelled_t const &)
+      {
+      }
+      catch (...)
+      {
+         queue.close(std::current_exception());
+      }
+   });
+
+   try
+   {
+      // Место под все секции готовится сразу: иначе хранилища с массивами
+      // при росте держали бы в памяти и прежний массив, и новый
+      chunk_t chunk;
+      for (bool first = true; queue.pop(chunk); first = false)
+      {
+         if (first)
+         {
+            auto const expected = queue.expected();
+            lab.reserve(std::size_t(std::min<std::uint64_t>(expected + expected / 16, SIZE_MAX)));
+         }
+         lab.add_sections(std::move(chunk), num_threads);
+      }
+   }
+   catch (...)
+   {
+      queue.cancel();
+      parser.join();
+      throw;
+   }
+   parser.join();
+   return seconds(parse_time);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+#include <boost/filesystem/path.hpp>
+
+
+/*!
+ * \brief Заполняет лабиринт секциями из файла по мере его разбора
+ * \param path файл лабиринта (текстовый или двоичный, см. load_sections)
+ * \param lab лабиринт, в который добавляются секции
+ * \param num_threads потоки для пакетного добавления, 0 - по числу ядер
+ * \return время разбора файла в секундах, без ожидания очереди
+ *
+ * Файл разбирается в отдельном потоке, порции секций передаются через
+ * очередь из нескольких порций и добавляются в лабиринт пакетно, пока
+ * разбирается следующая. Весь список секций в памяти не собирается,
+ * так что пиковый объём памяти - примерно размер самого лабиринта.
+ * Ошибка разбора передаётся в вызывающий поток.
+ */
+double build_labyrinth(boost::filesystem::path const & path,
+                       knossos::labyrinth_t & lab, unsigned num_threads);
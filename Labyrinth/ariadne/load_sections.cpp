@@ -1,79 +1,296 @@
 #include "load_sections.h"
+#include "board_binary.h"
 
+#include <boost/filesystem/operations.hpp>
 #include <boost/format.hpp>
-#include <fstream>
+#include <boost/predef/other/endian.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifndef _WIN32
+#  include <sys/types.h>
+#endif
 
 
 namespace fs = boost::filesystem;
 namespace
 {
-   struct file_istream_t
+   /*!
+    * \brief Чтение файла крупными блоками с разбором по указателю
+    *
+    * Блок читается одним fread, разбор идёт по буферу без потоков
+    * и локалей. Перед разбором числа в буфере гарантируется запас
+    * max_token байт (или конец файла), за концом данных лежат нули,
+    * поэтому число можно читать словами по 8 байт без проверок границ.
+    */
+   class board_reader_t
    {
-      file_istream_t( fs::path const & filepath )
-         : stream_(filepath.string().c_str())
+   public:
+      explicit board_reader_t(fs::path const & filepath)
+         : file_(std::fopen(filepath.string().c_str(), "rb"))
          , filename_(filepath.filename().string())
+         , buffer_(block_size + padding)
       {
-         if (!stream_.is_open())
+         if (!file_)
          {
             boost::format error("failed to open file '%1%'");
             throw std::runtime_error(str(error % filepath));
          }
+         pos_ = end_ = buffer_.data();
       }
 
-      explicit operator bool() const
+      ~board_reader_t()
       {
-         return !stream_.eof();
+         std::fclose(file_);
       }
 
-      void read_character( char expected, bool check_eof = false )
+      board_reader_t(board_reader_t const &) = delete;
+      board_reader_t & operator = (board_reader_t const &) = delete;
+
+      /*!
+       * Следующий значащий символ должен быть expected. Если check_eof,
+       * вместо него допустим конец файла, тогда возвращается false
+       */
+      bool read_character(char expected, bool check_eof = false)
       {
-         char ch = 0;
-         stream_ >> ch;
+         skip_spaces();
+         if (pos_ == end_ && !refill(1))
+         {
+            if (check_eof)
+               return false;
+            throw_expected({'\'', expected, '\''}, offset());
+         }
 
-         if (ch != expected)
-            if (!(check_eof && stream_.eof()))
-               throw_expected({ '\'', expected, '\''});
+         // Как и при чтении из потока, смещение - за прочитанным символом
+         if (*pos_++ != expected)
+            throw_expected({'\'', expected, '\''}, offset());
+         return true;
       }
 
-      void read_number( int & num )
+      /// Целое со знаком в диапазоне int, как у std::istream >> int
+      int read_number()
       {
-         stream_ >> num;
-         if (!stream_.good())
-            throw_expected("number");
+         skip_spaces();
+         refill(max_token);
+
+         auto const start = offset();
+         bool const negative = *pos_ == '-';
+         if (*pos_ == '-' || *pos_ == '+')
+            ++pos_;
+
+         auto digits = leading_digits(load(pos_));
+         if (digits == 0)
+            throw_expected("number", start);
+
+         std::uint64_t const limit = negative ? std::uint64_t(INT_MAX) + 1 : INT_MAX;
+         std::uint64_t value = parse_digits(load(pos_), digits);
+         pos_ += digits;
+
+         // Больше восьми цифр: остаток по одной, с проверкой переполнения
+         if (digits == 8)
+            while ((pos_ != end_ || refill(1)) && unsigned(*pos_ - '0') < 10)
+            {
+               value = value * 10 + unsigned(*pos_++ - '0');
+               if (value > limit)
+                  throw_expected("number", start);
+            }
+         if (value > limit)
+            throw_expected("number", start);
+
+         return negative ? int(-std::int64_t(value)) : int(value);
       }
 
    private:
-      [[ noreturn ]] void throw_expected(std::string const & expected)
+      static std::size_t const block_size = 1 << 20;
+      static std::size_t const max_token  = 64;
+      static std::size_t const padding    = 8;
+
+      std::uint64_t offset() const
+      {
+         return consumed_ + std::uint64_t(pos_ - buffer_.data());
+      }
+
+      /// Пробельные символы, как у std::isspace в локали "C"
+      static bool is_space(char ch)
+      {
+         return ch == ' ' || unsigned(ch - '\t') <= unsigned('\r' - '\t');
+      }
+
+      void skip_spaces()
+      {
+         for (;;)
+         {
+            while (pos_ != end_ && is_space(*pos_))
+               ++pos_;
+            if (pos_ != end_ || !refill(1))
+               return;
+         }
+      }
+
+      /*!
+       * Дочитывает файл, чтобы в буфере было не меньше need байт.
+       * Непрочитанный остаток переносится в начало буфера
+       */
+      bool refill(std::size_t need)
+      {
+         if (std::size_t(end_ - pos_) >= need)
+            return true;
+         if (eof_)
+            return false;
+
+         auto const rest = std::size_t(end_ - pos_);
+         consumed_ += std::uint64_t(pos_ - buffer_.data());
+         std::memmove(buffer_.data(), pos_, rest);
+
+         auto const read = std::fread(buffer_.data() + rest, 1, block_size - rest, file_);
+         eof_ = read != block_size - rest;
+
+         pos_ = buffer_.data();
+         end_ = pos_ + rest + read;
+         std::memset(const_cast<char *>(end_), 0, padding);
+         return std::size_t(end_ - pos_) >= need;
+      }
+
+      /// 8 байт начиная с p, первый байт - младший
+      static std::uint64_t load(char const * p)
+      {
+         std::uint64_t word;
+         std::memcpy(&word, p, sizeof(word));
+#if BOOST_ENDIAN_BIG_BYTE
+         word = __builtin_bswap64(word);
+#endif
+         return word;
+      }
+
+      /// Сколько цифр подряд в начале слова (до 8)
+      static unsigned leading_digits(std::uint64_t word)
+      {
+         // Байт - цифра, если его старшая тетрада 3 и после прибавления 6
+         // она не меняется. Перенос из нецифры портит лишь байты за ней
+         auto const high  = word & 0xF0F0F0F0F0F0F0F0ull;
+         auto const added = (word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull;
+         auto const other = (high ^ 0x3030303030303030ull) | (added ^ 0x3030303030303030ull);
+         if (other == 0)
+            return 8;
+
+         unsigned bit = 0;
+         while (!((other >> bit) & 0xFF))
+            bit += 8;
+         return bit / 8;
+      }
+
+      /// Значение первых digits (1..8) цифр слова: три умножения вместо цикла
+      static std::uint64_t parse_digits(std::uint64_t word, unsigned digits)
+      {
+         // Цифры сдвигаются к старшим байтам, младшие становятся нулями
+         word <<= 8 * (8 - digits);
+         word = (word & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+         word = (word & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+         return (word & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+      }
+
+      [[ noreturn ]] void throw_expected(std::string const & expected, std::uint64_t offset) const
       {
          boost::format error("%1%(%2%): invalid input, expected %3%");
          throw std::runtime_error(
-            str(error % filename_ % stream_.tellg() % expected)
+            str(error % filename_ % offset % expected)
          );
       }
 
    private:
-      std::ifstream stream_;
+      std::FILE *       file_;
       std::string const filename_;
+      std::vector<char> buffer_;
+      char const *      pos_;
+      char const *      end_;
+      std::uint64_t     consumed_ = 0;  ///< смещение начала буфера в файле
+      bool              eof_ = false;
    };
+
+   /// Переход к смещению offset; long, которого ждёт fseek, на Windows
+   /// 32-битный, а файлы лабиринтов бывают больше 2 Гб
+   bool seek_file(std::FILE * file, std::uint64_t offset)
+   {
+#ifdef _WIN32
+      return _fseeki64(file, __int64(offset), SEEK_SET) == 0;
+#else
+      return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+   }
+
+   /*!
+    * Оценка числа секций текстового файла: секции считаются по '('
+    * в блоках, равномерно разбросанных по файлу. Небольшой файл
+    * просматривается целиком
+    */
+   std::uint64_t estimate_sections(fs::path const & filepath)
+   {
+      std::size_t const samples = 16, sample_size = 1 << 16;
+      auto const size = fs::file_size(filepath);
+      auto const step = std::max<std::uint64_t>(size / samples, sample_size);
+
+      std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(
+         std::fopen(filepath.string().c_str(), "rb"), &std::fclose);
+      std::vector<char> block(sample_size);
+      std::uint64_t read = 0, count = 0;
+      for (std::uint64_t offset = 0; file && offset < size; offset += step)
+      {
+         if (!seek_file(file.get(), offset))
+            break;
+         auto const length = std::fread(block.data(), 1, block.size(), file.get());
+         count += std::uint64_t(std::count(block.begin(), block.begin() + length, '('));
+         read  += length;
+      }
+      return read != 0 ? count * size / read : 0;
+   }
 }
 
 void load_sections(fs::path const & filepath,
-                   std::vector<knossos::position_t> & sections)
+                   sections_sink_t const & sink, std::size_t chunk_size)
 {
-   sections.clear();
+   if (is_binary_board(filepath))
+      return load_sections_binary(filepath, sink, chunk_size);
 
-   file_istream_t file(filepath);
-   while (file)
+   board_reader_t file(filepath);
+   auto const expected = estimate_sections(filepath);
+   std::vector<knossos::position_t> chunk;
+   chunk.reserve(chunk_size);
+   do
    {
       knossos::position_t pos;
 
       file.read_character('(');
-      file.read_number(pos.x);
+      pos.x = file.read_number();
       file.read_character(',');
-      file.read_number(pos.y);
+      pos.y = file.read_number();
       file.read_character(')');
-      file.read_character(',', true);
 
-      sections.push_back(pos);
+      chunk.push_back(pos);
+      if (chunk.size() == chunk_size)
+      {
+         sink(chunk, expected);
+         chunk.clear();
+      }
    }
+   while (file.read_character(',', true));
+
+   sink(chunk, expected);
+}
+
+void load_sections(fs::path const & filepath,
+                   std::vector<knossos::position_t> & sections)
+{
+   sections.clear();
+   load_sections(filepath, [&sections](std::vector<knossos::position_t> & chunk, std::uint64_t)
+   {
+      if (sections.empty())
+         sections.swap(chunk);
+      else
+         sections.insert(sections.end(), chunk.begin(), chunk.end());
+   }, std::size_t(1) << 20);
 }
@@ -2,8 +2,29 @@
 
 #include <knossos/labyrinth.h>
 #include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 
+/// Секции из текстового файла "(x, y), ..." или из двоичного (см. board_binary.h)
 void load_sections(boost::filesystem::path const & path,
                    std::vector<knossos::position_t> & sections);
+
+/*!
+ * \brief Приёмник секций, прочитанных очередной порцией
+ *
+ * Порция передаётся по ссылке: приёмник может забрать её, обменяв на
+ * другой вектор. После возврата содержимое вектора отбрасывается, а его
+ * память используется для следующей порции. Второй аргумент - ожидаемое
+ * число секций во всём файле: точное для двоичного файла, для текстового -
+ * оценка по выборке из него.
+ */
+typedef
+   std::function<void (std::vector<knossos::position_t> &, std::uint64_t)>
+   sections_sink_t;
+
+/// Секции из файла порциями не больше chunk_size по мере чтения
+void load_sections(boost::filesystem::path const & path,
+                   sections_sink_t const & sink, std::size_t chunk_size);
@@ -1,52 +1,82 @@
 #include "arguments.h"
 #include "load_sections.h"
+#include "board_binary.h"
+#include "build_labyrinth.h"
+#include "routes.h"
+#include "server.h"
+#include "print_stats.h"
 
-#include <boost/format.hpp>
-#include <boost/range/adaptor/transformed.hpp>
-
+#include <chrono>
 #include <fstream>
 #include <iostream>
 
 
-namespace ba = boost::adaptors;
-
-namespace
-{
-   knossos::direction_t char_to_dir(char ch)
-   {
-      switch (ch)
-      {
-      case 'u': return knossos::dir_up;
-      case 'd': return knossos::dir_down;
-      case 'l': return knossos::dir_left;
-      case 'r': return knossos::dir_right;
-      default:
-         {
-            boost::format error("invalid route character: %1%");
-            throw std::runtime_error(str(error % ch));
-         }
-      }
-   }
-}
-
 int main(int argc, char *argv[])
 {
    try
    {
+      auto const start = std::chrono::steady_clock::now();
       auto args = parse_arguments(argc, argv);
       if (!args)
          return 0;
 
-      std::vector<knossos::position_t> sections;
-      load_sections(args->board_path, sections);
+      if (!args->convert_path.empty())
+      {
+         std::vector<knossos::position_t> sections;
+         load_sections(args->board_path, sections);
+         save_sections_binary(args->convert_path, sections);
+         return 0;
+      }
+
+      run_times_t times;
+      auto const report_stats = [&]
+      {
+         if (!args->stats)
+            return;
+         auto const elapsed = std::chrono::steady_clock::now() - start;
+         times.total = std::chrono::duration<double>(elapsed).count();
+         print_stats(std::cerr, knossos::stats(), times, args->stats_json);
+      };
+
+      knossos::labyrinth_t lab(args->storage);
+      times.parse = build_labyrinth(args->board_path, lab, args->threads);
 
-      knossos::labyrinth_t lab(sections);
+      if (args->serve || !args->socket_path.empty())
+      {
+         server_options_t options;
+         options.rle = args->rle;
+         options.threads = args->threads;
+         if (args->serve)
+            serve_stdio(lab.snapshot(), options);
+         else
+            serve_socket(lab.snapshot(), args->socket_path, options);
+         report_stats();
+         return 0;
+      }
       if (!lab.set_position(knossos::position_t{args->x0, args->y0}))
       {
          std::cerr << "incorrect start position: " << args->x0 << " " << args->y0 << std::endl;
          return 1;
       }
-      lab.navigate(args->route | ba::transformed(&char_to_dir));
+
+      auto const first = args->route.data();
+      auto const last  = first + args->route.size();
+      if (!args->route_file.empty())
+         navigate_file(lab, args->route_file, args->rle);
+      else if (args->rle)
+      {
+         std::vector<knossos::route_run_t> runs;
+         decode_runs(first, last, runs);
+         lab.navigate(runs.data(), runs.data() + runs.size());
+      }
+      else
+      {
+         // Маршрут разбирается до навигации, чтобы цикл по шагам не содержал
+         // проверок и проходил по непрерывному массиву
+         std::vector<std::uint8_t> route;
+         decode_route(first, last, route);
+         lab.navigate(route.data(), route.size());
+      }
 
       auto const & pos = lab.position();
       if (args->output_path.empty())
@@ -61,6 +91,7 @@ int main(int argc, char *argv[])
          }
          outf << "(" << pos.x << "," << pos.y << ")";
       }
+      report_stats();
       return 0;
    }
    catch (std::exception const & e)
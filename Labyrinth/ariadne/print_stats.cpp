@@ -0,0 +1,70 @@
+#include "print_stats.h"
+
+#include <iomanip>
+#include <string>
+#include <ostream>
+#include <utility>
+
+
+namespace
+{
+   typedef std::pair<char const *, std::uint64_t> counter_t;
+
+   void print_json(std::ostream & out, knossos::stats_t const & stats,
+                   run_times_t const & times, counter_t const (&counters)[6])
+   {
+      out << "{\"enabled\": " << (stats.enabled ? "true" : "false") << ", \"counters\": {";
+      for (auto const & counter : counters)
+         out << (&counter == counters ? "" : ", ")
+             << "\"" << counter.first << "\": " << counter.second;
+
+      out << "}, \"seconds\": {\"parse\": " << times.parse;
+      for (int phase = 0; phase != knossos::phase_num; ++phase)
+         out << ", \"" << knossos::phase_name(knossos::phase_t(phase)) << "\": "
+             << stats.seconds[phase];
+      out << ", \"total\": " << times.total << "}}" << std::endl;
+   }
+
+   void print_table(std::ostream & out, knossos::stats_t const & stats,
+                    run_times_t const & times, counter_t const (&counters)[6])
+   {
+      out << "statistics:" << std::endl;
+      if (stats.enabled)
+         for (auto const & counter : counters)
+            out << "  " << std::left << std::setw(20) << counter.first
+                << std::right << std::setw(16) << counter.second << std::endl;
+      else
+         out << "  knossos counters are disabled (build with WITH_STATS=ON)" << std::endl;
+
+      auto const print_time = [&out](char const * name, double seconds)
+      {
+         out << "  " << std::left << std::setw(20) << (std::string(name) + ", s")
+             << std::right << std::setw(16) << std::fixed << std::setprecision(6)
+             << seconds << std::endl;
+      };
+      print_time("parse", times.parse);
+      if (stats.enabled)
+         for (int phase = 0; phase != knossos::phase_num; ++phase)
+            print_time(knossos::phase_name(knossos::phase_t(phase)), stats.seconds[phase]);
+      print_time("total", times.total);
+   }
+}
+
+void print_stats(std::ostream & out, knossos::stats_t const & stats,
+                 run_times_t const & times, bool json)
+{
+   counter_t const counters[] =
+   {
+      counter_t("sections_inserted",  stats.sections_inserted),
+      counter_t("duplicates_skipped", stats.duplicates_skipped),
+      counter_t("sections_removed",   stats.sections_removed),
+      counter_t("lookups",            stats.lookups),
+      counter_t("steps_taken",        stats.steps_taken),
+      counter_t("steps_blocked",      stats.steps_blocked)
+   };
+
+   if (json)
+      print_json(out, stats, times, counters);
+   else
+      print_table(out, stats, times, counters);
+}
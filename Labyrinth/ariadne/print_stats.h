@@ -0,0 +1,23 @@
+#pragma once
+
+#include <knossos/stats.h>
+
+#include <iosfwd>
+
+
+/// Время этапов ariadne вне knossos
+struct run_times_t
+{
+   double parse = 0;   ///< разбор файла лабиринта, см. build_labyrinth
+   double total = 0;   ///< вся работа от разбора аргументов до ответа
+};
+
+/*!
+ * \brief Вывод статистики knossos::stats() и времени этапов (опция --stats)
+ * \param json одним объектом JSON, иначе таблицей для чтения
+ *
+ * В сборке без WITH_STATS счётчиков knossos нет, выводится только время
+ * ariadne и признак "enabled": false
+ */
+void print_stats(std::ostream & out, knossos::stats_t const & stats,
+                 run_times_t const & times, bool json);
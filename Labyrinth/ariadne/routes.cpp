@@ -0,0 +1,204 @@
+#include "routes.h"
+
+#include <boost/format.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define ARIADNE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+namespace
+{
+   /// Символ пропускается
+   std::uint8_t const skip_code    = knossos::total_num;
+   /// Символ недопустим
+   std::uint8_t const invalid_code = 0xff;
+
+   struct code_table_t
+   {
+      code_table_t()
+      {
+         for (auto & code : codes)
+            code = invalid_code;
+         codes[std::uint8_t('u')] = knossos::dir_up;
+         codes[std::uint8_t('l')] = knossos::dir_left;
+         codes[std::uint8_t('d')] = knossos::dir_down;
+         codes[std::uint8_t('r')] = knossos::dir_right;
+         for (char space : {' ', '\t', '\r', '\n', '\v', '\f'})
+            codes[std::uint8_t(space)] = skip_code;
+      }
+
+      std::uint8_t codes[256];
+   };
+
+   code_table_t const table;
+
+   std::uint8_t * decode_scalar(char const * first, char const * last, std::uint8_t * out)
+   {
+      for (; first != last; ++first)
+      {
+         auto const code = table.codes[std::uint8_t(*first)];
+         if (code == invalid_code)
+            char_to_dir(*first);   // кидает исключение с символом
+         *out = code;
+         out += code != skip_code;
+      }
+      return out;
+   }
+
+   /// Блок чтения файла маршрута
+   std::size_t const file_block = 1 << 20;
+}
+
+knossos::direction_t char_to_dir(char ch)
+{
+   switch (ch)
+   {
+   case 'u': return knossos::dir_up;
+   case 'd': return knossos::dir_down;
+   case 'l': return knossos::dir_left;
+   case 'r': return knossos::dir_right;
+   default:
+      {
+         boost::format error("invalid route character: %1%");
+         throw std::runtime_error(str(error % ch));
+      }
+   }
+}
+
+std::size_t decode_codes(char const * first, char const * last, std::uint8_t * out)
+{
+   auto const start = out;
+#ifdef ARIADNE_SSE2
+   // Коды выбираются масками сравнения: u - 0, l - 1, d - 2, r - 3
+   auto const up    = _mm_set1_epi8('u');
+   auto const left  = _mm_set1_epi8('l');
+   auto const down  = _mm_set1_epi8('d');
+   auto const right = _mm_set1_epi8('r');
+   for (; last - first >= 16; first += 16)
+   {
+      auto const text = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first));
+      auto const is_up    = _mm_cmpeq_epi8(text, up);
+      auto const is_left  = _mm_cmpeq_epi8(text, left);
+      auto const is_down  = _mm_cmpeq_epi8(text, down);
+      auto const is_right = _mm_cmpeq_epi8(text, right);
+
+      auto const valid = _mm_or_si128(_mm_or_si128(is_up, is_left), _mm_or_si128(is_down, is_right));
+      if (_mm_movemask_epi8(valid) != 0xffff)
+      {
+         out = decode_scalar(first, first + 16, out);
+         continue;
+      }
+
+      auto const codes = _mm_or_si128(
+         _mm_and_si128(is_left, _mm_set1_epi8(knossos::dir_left)),
+         _mm_or_si128(_mm_and_si128(is_down, _mm_set1_epi8(knossos::dir_down)),
+                      _mm_and_si128(is_right, _mm_set1_epi8(knossos::dir_right))));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), codes);
+      out += 16;
+   }
+#endif
+   return std::size_t(decode_scalar(first, last, out) - start);
+}
+
+void decode_route(char const * first, char const * last, std::vector<std::uint8_t> & route)
+{
+   route.resize(std::size_t(last - first));
+   route.resize(decode_codes(first, last, route.data()));
+}
+
+void runs_decoder_t::decode(char const * first, char const * last,
+                            std::vector<knossos::route_run_t> & runs)
+{
+   for (; first != last; ++first)
+   {
+      auto const ch = *first;
+      auto const code = table.codes[std::uint8_t(ch)];
+      if (code == skip_code)
+         continue;
+
+      if (unsigned(ch - '0') < 10)
+      {
+         if (run_.dir == knossos::total_num)
+            char_to_dir(ch);   // число без направления
+
+         std::uint64_t const digit = unsigned(ch - '0');
+         if (run_.count > (UINT64_MAX - digit) / 10)
+            throw std::runtime_error("too long route run");
+         run_.count = run_.count * 10 + digit;
+         digits_ = true;
+         continue;
+      }
+
+      auto const dir = char_to_dir(ch);
+      finish(runs);
+      run_.dir = dir;
+   }
+}
+
+void runs_decoder_t::finish(std::vector<knossos::route_run_t> & runs)
+{
+   if (run_.dir != knossos::total_num)
+      runs.push_back(knossos::route_run_t{run_.dir, digits_ ? run_.count : 1});
+   run_ = knossos::route_run_t{knossos::total_num, 0};
+   digits_ = false;
+}
+
+void decode_runs(char const * first, char const * last,
+                 std::vector<knossos::route_run_t> & runs)
+{
+   runs_decoder_t decoder;
+   runs.clear();
+   decoder.decode(first, last, runs);
+   decoder.finish(runs);
+}
+
+void navigate_file(knossos::labyrinth_t & lab, std::string const & path, bool rle)
+{
+   std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(nullptr, &std::fclose);
+   if (path != "-")
+   {
+      file.reset(std::fopen(path.c_str(), "rb"));
+      if (!file)
+      {
+         boost::format error("failed to open file '%1%'");
+         throw std::runtime_error(str(error % path));
+      }
+   }
+   auto const input = file ? file.get() : stdin;
+
+   std::vector<char> block(file_block);
+   std::vector<std::uint8_t> codes(file_block);
+   std::vector<knossos::route_run_t> runs;
+   runs_decoder_t decoder;
+
+   for (;;)
+   {
+      auto const size = std::fread(block.data(), 1, block.size(), input);
+      auto const first = block.data();
+      if (rle)
+      {
+         runs.clear();
+         decoder.decode(first, first + size, runs);
+         if (size == 0)
+            decoder.finish(runs);
+         lab.navigate(runs.data(), runs.data() + runs.size());
+      }
+      else
+         lab.navigate(codes.data(), decode_codes(first, first + size, codes.data()));
+
+      if (size == 0)
+         break;
+   }
+
+   if (std::ferror(input))
+   {
+      boost::format error("failed to read file '%1%'");
+      throw std::runtime_error(str(error % path));
+   }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/// Направление по символу маршрута: u, d, l или r
+knossos::direction_t char_to_dir(char ch);
+
+/*!
+ * \brief Перевод символов маршрута в коды направлений (значения direction_t)
+ * \param out место не меньше чем под last - first кодов
+ * \return количество записанных кодов
+ * \throw std::runtime_error на символе, отличном от udlr и пробельных
+ *
+ * Пробельные символы пропускаются. Блоки по 16 символов проверяются
+ * и переводятся командами SSE2 (если они доступны), блок с пробельным
+ * или недопустимым символом разбирается по одному символу.
+ */
+std::size_t decode_codes(char const * first, char const * last, std::uint8_t * out);
+
+/// Маршрут вида "rruld" в коды направлений (содержимое route заменяется)
+void decode_route(char const * first, char const * last, std::vector<std::uint8_t> & route);
+
+/*!
+ * \brief Разбор маршрута длинами серий вида "r120u7l" по частям
+ *
+ * Направление и необязательное число шагов (по умолчанию 1), пробельные
+ * символы пропускаются. Серия может продолжаться в следующей части,
+ * поэтому последняя серия выдаётся только finish()
+ */
+class runs_decoder_t
+{
+public:
+   /// Дописывает в runs серии, законченные в [first, last)
+   void decode(char const * first, char const * last, std::vector<knossos::route_run_t> & runs);
+
+   /// Конец маршрута: дописывает последнюю серию
+   void finish(std::vector<knossos::route_run_t> & runs);
+
+private:
+   knossos::route_run_t run_{knossos::total_num, 0};
+   bool                 digits_ = false;
+};
+
+/// Маршрут длинами серий целиком (содержимое runs заменяется)
+void decode_runs(char const * first, char const * last,
+                 std::vector<knossos::route_run_t> & runs);
+
+/*!
+ * \brief Навигация по маршруту из файла
+ * \param lab лабиринт с заданным текущим положением
+ * \param path файл маршрута, "-" - стандартный ввод
+ * \param rle маршрут задан длинами серий
+ *
+ * Файл читается и разбирается блоками, после каждого блока лабиринт
+ * проходит уже разобранную часть маршрута, так что память не зависит
+ * от длины маршрута.
+ */
+void navigate_file(knossos::labyrinth_t & lab, std::string const & path, bool rle);
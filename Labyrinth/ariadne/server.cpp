@@ -0,0 +1,354 @@
+#include "server.h"
+#include "routes.h"
+
+#include <boost/asio.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+
+
+namespace asio = boost::asio;
+namespace
+{
+   /// Начальный размер буфера запросов, растёт под длинные строки
+   std::size_t const initial_buffer = 1 << 16;
+
+   bool is_space(char ch)
+   {
+      return ch == ' ' || ch == '\t' || ch == '\r';
+   }
+
+   void skip_spaces(char const *& pos, char const * last)
+   {
+      while (pos != last && is_space(*pos))
+         ++pos;
+   }
+
+   [[ noreturn ]] void throw_invalid(char const * expected)
+   {
+      throw std::runtime_error(std::string("invalid query, expected ") + expected);
+   }
+
+   int parse_number(char const *& pos, char const * last)
+   {
+      skip_spaces(pos, last);
+      bool const negative = pos != last && *pos == '-';
+      if (pos != last && (*pos == '-' || *pos == '+'))
+         ++pos;
+      if (pos == last || unsigned(*pos - '0') >= 10)
+         throw_invalid("number");
+
+      long long const limit = negative ? -(long long)(INT_MIN) : INT_MAX;
+      long long value = 0;
+      for (; pos != last && unsigned(*pos - '0') < 10; ++pos)
+         if ((value = value * 10 + (*pos - '0')) > limit)
+            throw_invalid("number");
+      return int(negative ? -value : value);
+   }
+
+   void parse_comma(char const *& pos, char const * last)
+   {
+      skip_spaces(pos, last);
+      if (pos == last || *pos != ',')
+         throw_invalid("','");
+      ++pos;
+   }
+
+   /*!
+    * \brief Запросы одного источника: буфер ввода, ответы и свой курсор
+    *
+    * Ввод дописывается в space() и подтверждается received(), после чего
+    * на все полные строки готовы ответы в answers()
+    */
+   class query_stream_t
+   {
+   public:
+      query_stream_t(knossos::snapshot_t const & map, bool rle)
+         : cursor_(map)
+         , rle_(rle)
+         , buffer_(initial_buffer)
+      {}
+
+      /// Свободное место в буфере, не меньше половины его размера
+      std::pair<char *, std::size_t> space()
+      {
+         if (used_ * 2 > buffer_.size())
+            buffer_.resize(buffer_.size() * 2);
+         return std::make_pair(buffer_.data() + used_, buffer_.size() - used_);
+      }
+
+      void received(std::size_t size)
+      {
+         auto const first = buffer_.data();
+         auto const last  = first + used_ + size;
+
+         // Новый перевод строки может быть только среди новых байт
+         auto line = first;
+         for (auto pos = first + used_; pos != last; ++pos)
+            if (*pos == '\n')
+            {
+               answer(line, pos);
+               line = pos + 1;
+            }
+
+         used_ = std::size_t(last - line);
+         std::memmove(first, line, used_);
+      }
+
+      /// Конец ввода: последняя строка может быть без перевода строки
+      void finish()
+      {
+         answer(buffer_.data(), buffer_.data() + used_);
+         used_ = 0;
+      }
+
+      std::string & answers()
+      {
+         return answers_;
+      }
+
+   private:
+      void answer(char const * first, char const * last)
+      {
+         skip_spaces(first, last);
+         if (first == last)
+            return;
+
+         try
+         {
+            auto pos = first;
+            auto const x = parse_number(pos, last);
+            parse_comma(pos, last);
+            auto const y = parse_number(pos, last);
+            parse_comma(pos, last);
+            skip_spaces(pos, last);
+            while (last != pos && is_space(last[-1]))
+               --last;
+
+            knossos::position_t const start(x, y);
+            knossos::position_t end;
+            if (rle_)
+            {
+               decode_runs(pos, last, runs_);
+               end = cursor_.navigate(runs_.data(), runs_.data() + runs_.size(), start);
+            }
+            else
+            {
+               decode_route(pos, last, route_);
+               end = cursor_.navigate(route_.data(), route_.size(), start);
+            }
+
+            char text[32];
+            auto const length = std::snprintf(text, sizeof(text), "(%d,%d)\n", end.x, end.y);
+            answers_.append(text, std::size_t(length));
+         }
+         catch (std::exception const & e)
+         {
+            answers_ += "error: ";
+            answers_ += e.what();
+            answers_ += '\n';
+         }
+      }
+
+   private:
+      knossos::cursor_t                  cursor_;
+      bool const                         rle_;
+      std::vector<char>                  buffer_;
+      std::size_t                        used_ = 0;
+      std::string                        answers_;
+      std::vector<std::uint8_t>          route_;
+      std::vector<knossos::route_run_t>  runs_;
+   };
+
+#ifdef _WIN32
+   int read_input(void * data, std::size_t size)
+   {
+      return _read(0, data, unsigned(size));
+   }
+
+   int write_output(void const * data, std::size_t size)
+   {
+      return _write(1, data, unsigned(size));
+   }
+#else
+   ssize_t read_input(void * data, std::size_t size)
+   {
+      return ::read(STDIN_FILENO, data, size);
+   }
+
+   ssize_t write_output(void const * data, std::size_t size)
+   {
+      return ::write(STDOUT_FILENO, data, size);
+   }
+#endif
+
+   void write_answers(std::string & answers)
+   {
+      for (std::size_t done = 0; done != answers.size();)
+      {
+         auto const written = write_output(answers.data() + done, answers.size() - done);
+         if (written < 0 && errno == EINTR)
+            continue;
+         if (written <= 0)
+            throw std::runtime_error("failed to write answers");
+         done += std::size_t(written);
+      }
+      answers.clear();
+   }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+   typedef asio::local::stream_protocol protocol_t;
+
+   /// Соединение: чтение, ответы на прочитанное одной записью, снова чтение
+   class session_t : public std::enable_shared_from_this<session_t>
+   {
+   public:
+      session_t(knossos::snapshot_t const & map, bool rle, protocol_t::socket && socket)
+         : queries_(map, rle)
+         , socket_(std::move(socket))
+      {}
+
+      void read()
+      {
+         auto const space = queries_.space();
+         auto self = shared_from_this();
+         socket_.async_read_some(asio::buffer(space.first, space.second),
+            [self](boost::system::error_code const & error, std::size_t size)
+            {
+               self->on_read(error, size);
+            });
+      }
+
+   private:
+      void on_read(boost::system::error_code const & error, std::size_t size)
+      {
+         queries_.received(size);
+         if (error)
+            queries_.finish();
+
+         if (queries_.answers().empty())
+         {
+            if (!error)
+               read();
+            return;
+         }
+
+         auto self = shared_from_this();
+         auto const more = !error;
+         asio::async_write(socket_, asio::buffer(queries_.answers()),
+            [self, more](boost::system::error_code const & error, std::size_t)
+            {
+               self->queries_.answers().clear();
+               if (!error && more)
+                  self->read();
+            });
+      }
+
+      query_stream_t      queries_;
+      protocol_t::socket  socket_;
+   };
+
+   /*!
+    * \brief Принимает соединения, пока открыт
+    *
+    * Приём и закрытие по сигналу идут через один strand: acceptor нельзя
+    * одновременно закрывать из одного потока и использовать из другого
+    */
+   struct listener_t
+   {
+      asio::io_service &          io;
+      asio::io_service::strand &  strand;
+      knossos::snapshot_t const & map;
+      bool                        rle;
+      protocol_t::acceptor &      acceptor;
+      protocol_t::socket          socket;
+
+      void accept()
+      {
+         acceptor.async_accept(socket, strand.wrap([this](boost::system::error_code const & error)
+         {
+            if (!error)
+               std::make_shared<session_t>(map, rle, std::move(socket))->read();
+            if (acceptor.is_open())
+            {
+               socket = protocol_t::socket(io);
+               accept();
+            }
+         }));
+      }
+   };
+#endif
+}
+
+void serve_stdio(knossos::snapshot_t const & map, server_options_t const & options)
+{
+   // Чтение возвращает то, что уже пришло, поэтому ответы на все запросы
+   // одного чтения уходят одной записью, не дожидаясь следующих
+   query_stream_t queries(map, options.rle);
+   for (;;)
+   {
+      auto const space = queries.space();
+      auto const size = read_input(space.first, space.second);
+      if (size < 0 && errno == EINTR)
+         continue;
+      if (size < 0)
+         throw std::runtime_error("failed to read queries");
+      if (size == 0)
+         break;
+
+      queries.received(std::size_t(size));
+      write_answers(queries.answers());
+   }
+
+   queries.finish();
+   write_answers(queries.answers());
+}
+
+void serve_socket(knossos::snapshot_t const & map, std::string const & path,
+                  server_options_t const & options)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+   asio::io_service io;
+
+   // Файл сокета мог остаться от прежнего запуска
+   std::remove(path.c_str());
+   protocol_t::acceptor acceptor(io, protocol_t::endpoint(path));
+   asio::io_service::strand strand(io);
+   listener_t listener{io, strand, map, options.rle, acceptor, protocol_t::socket(io)};
+   listener.accept();
+
+   asio::signal_set signals(io, SIGINT, SIGTERM);
+   signals.async_wait(strand.wrap([&](boost::system::error_code const &, int)
+   {
+      acceptor.close();
+      io.stop();
+   }));
+
+   auto threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+   std::vector<std::thread> workers;
+   for (unsigned i = 1; i < threads; ++i)
+      workers.emplace_back([&io] { io.run(); });
+   io.run();
+   for (auto & worker : workers)
+      worker.join();
+
+   std::remove(path.c_str());
+#else
+   (void)map;
+   (void)path;
+   (void)options;
+   throw std::runtime_error("local sockets are not supported on this platform");
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <knossos/snapshot.h>
+
+#include <string>
+
+
+/*!
+ * \brief Режим сервера: ответы на запросы по загруженному один раз лабиринту
+ *
+ * Запрос - строка "x, y, route": начальные координаты и маршрут (при rle -
+ * длинами серий, см. decode_runs). Ответ - строка "(x,y)" с конечной точкой
+ * или "error: ..." в том же порядке, что и запросы. Все запросы, пришедшие
+ * одним чтением, разбираются подряд, а ответы на них отправляются одной
+ * записью. У каждого источника запросов свой курсор по общему снимку карты.
+ */
+struct server_options_t
+{
+   bool     rle = false;
+   unsigned threads = 0;   ///< потоки обработки соединений, 0 - по числу ядер
+};
+
+/// Запросы из стандартного ввода, ответы в стандартный вывод, до конца ввода
+void serve_stdio(knossos::snapshot_t const & map, server_options_t const & options);
+
+/*!
+ * \brief Запросы из соединений с локальным сокетом path, до SIGINT/SIGTERM
+ *
+ * Соединения обрабатываются одновременно в options.threads потоках,
+ * каждое - со своим курсором
+ */
+void serve_socket(knossos::snapshot_t const & map, std::string const & path,
+                  server_options_t const & options);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace bench
+{
+   /// Секундомер, запускается при создании
+   class timer_t
+   {
+   public:
+      timer_t()
+         : start_(clock_t::now())
+      {}
+
+      double seconds() const
+      {
+         return std::chrono::duration<double>(clock_t::now() - start_).count();
+      }
+
+   private:
+      typedef std::chrono::steady_clock clock_t;
+      clock_t::time_point start_;
+   };
+
+   /// Прямоугольник width x height, из которого выброшена доля holes секций.
+   /// Секции перемешаны, как в файле, записанном в произвольном порядке
+   inline std::vector<knossos::position_t> dense_board(int width, int height,
+                                                       double holes, unsigned seed)
+   {
+      std::mt19937 gen(seed);
+      std::bernoulli_distribution hole(holes);
+
+      std::vector<knossos::position_t> board;
+      board.reserve(std::size_t(width) * height);
+      for (int x = 0; x < width; ++x)
+         for (int y = 0; y < height; ++y)
+            if (!hole(gen))
+               board.emplace_back(x, y);
+
+      std::shuffle(board.begin(), board.end(), gen);
+      return board;
+   }
+
+   inline std::vector<knossos::direction_t> random_route(std::size_t length, unsigned seed)
+   {
+      std::mt19937 gen(seed);
+      std::uniform_int_distribution<int> dir(0, knossos::total_num - 1);
+
+      std::vector<knossos::direction_t> route(length);
+      for (auto & step : route)
+         step = knossos::direction_t(dir(gen));
+      return route;
+   }
+
+   inline char const * storage_name(knossos::storage_type_t storage)
+   {
+      switch (storage)
+      {
+      case knossos::storage_tree:      return "tree";
+      case knossos::storage_hash:      return "hash";
+      case knossos::storage_bitmap:    return "bitmap";
+      case knossos::storage_compact:   return "compact";
+      case knossos::storage_versioned: return "versioned";
+      }
+      return "unknown";
+   }
+
+   inline void report(std::string const & name, double value, std::string const & unit)
+   {
+      std::cout << std::left << std::setw(40) << name
+                << std::right << std::setw(14) << std::fixed << std::setprecision(3)
+                << value << " " << unit << std::endl;
+   }
+}
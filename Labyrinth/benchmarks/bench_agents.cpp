@@ -0,0 +1,49 @@
+#include "bench.h"
+
+#include <knossos/agents.h>
+
+#include <cstdlib>
+
+/*
+ * Множество агентов со своими маршрутами: navigate для каждого агента
+ * против agents_t в один поток и на всех ядрах:
+ *    bench_agents [side] [agents] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 1024;
+   std::size_t const count = argc > 2 ? std::atol(argv[2]) : 50000;
+   std::size_t const route_length = argc > 3 ? std::atol(argv[3]) : 2000;
+
+   auto const board = bench::dense_board(side, side, 0.2, 1);
+   std::vector<std::vector<knossos::direction_t>> routes;
+   for (std::size_t i = 0; i != count; ++i)
+      routes.push_back(bench::random_route(route_length, unsigned(i)));
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "agents: " << count << ", route: " << route_length << " steps" << std::endl;
+
+   knossos::labyrinth_t lab(board, boost::none, knossos::storage_compact);
+   lab.optimize();
+   auto const map = lab.snapshot();
+   double const steps = double(count) * route_length;
+
+   bench::timer_t navigate_timer;
+   knossos::cursor_t cursor(map);
+   for (std::size_t i = 0; i != count; ++i)
+      cursor.navigate(routes[i].data(), routes[i].data() + routes[i].size(), board[i]);
+   bench::report("navigate", steps / navigate_timer.seconds() / 1e6, "Msteps/s");
+
+   for (unsigned threads : {1u, 0u})
+   {
+      knossos::agents_t agents(map, threads);
+      for (std::size_t i = 0; i != count; ++i)
+         agents.add(board[i], routes[i].data(), routes[i].data() + routes[i].size());
+
+      bench::timer_t timer;
+      agents.advance(route_length);
+      bench::report(threads == 1 ? "agents.single" : "agents.all_cores",
+                    steps / timer.seconds() / 1e6, "Msteps/s");
+   }
+   return 0;
+}
@@ -0,0 +1,47 @@
+#include "bench.h"
+
+#include <knossos/bitboard.h>
+
+#include <cstdlib>
+
+/*
+ * Маршрут из всех секций: navigate для каждой секции против битовой карты:
+ *    bench_all_starts [side] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 512;
+   std::size_t const route_length = argc > 2 ? std::atol(argv[2]) : 1000;
+
+   auto const board = bench::dense_board(side, side, 0.2, 1);
+   auto const route = bench::random_route(route_length, 2);
+   auto const first = route.data();
+   auto const last  = route.data() + route.size();
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "route: " << route.size() << " steps" << std::endl;
+
+   knossos::labyrinth_t lab(board, boost::none, knossos::storage_bitmap);
+   auto const map = lab.snapshot();
+   double const steps = double(board.size()) * route.size();
+
+   bench::timer_t navigate_timer;
+   knossos::cursor_t cursor(map);
+   for (auto const & start : board)
+      cursor.navigate(first, last, start);
+   bench::report("navigate", steps / navigate_timer.seconds() / 1e6, "Msteps/s");
+
+   knossos::bitboard_t const bits(map);
+
+   bench::timer_t occupied_timer;
+   auto const occupied = bits.occupied(first, last);
+   bench::report("bitboard.occupied", steps / occupied_timer.seconds() / 1e6, "Msteps/s");
+
+   std::vector<knossos::position_t> starts, ends;
+   bench::timer_t mapping_timer;
+   bits.mapping(first, last, starts, ends);
+   bench::report("bitboard.mapping", steps / mapping_timer.seconds() / 1e6, "Msteps/s");
+
+   std::cout << "occupied: " << occupied.size() << " sections" << std::endl;
+   return 0;
+}
@@ -0,0 +1,44 @@
+#include "bench.h"
+
+#include <cstdlib>
+#include <thread>
+
+
+/*
+ * Масштабирование labyrinth_t::navigate_batch по числу потоков:
+ *    bench_batch [side] [queries] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 1000;
+   std::size_t const num_queries  = argc > 2 ? std::atol(argv[2]) : 10000;
+   std::size_t const route_length = argc > 3 ? std::atol(argv[3]) : 10000;
+
+   auto const board = bench::dense_board(side, side, 0.1, 1);
+   auto const route = bench::random_route(num_queries + route_length, 2);
+
+   knossos::labyrinth_t lab(board, boost::none, knossos::storage_compact);
+   lab.optimize();
+
+   // Маршруты - пересекающиеся отрезки одного длинного маршрута
+   std::vector<knossos::route_query_t> queries;
+   for (std::size_t i = 0; i != num_queries; ++i)
+      queries.push_back({board[i % board.size()], route.data() + i, route_length});
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "queries: " << num_queries << " x " << route_length << " steps" << std::endl;
+
+   std::vector<boost::optional<knossos::position_t>> results;
+   auto const cores = std::max(1u, std::thread::hardware_concurrency());
+   for (unsigned threads = 1; threads <= cores; threads *= 2)
+   {
+      bench::timer_t timer;
+      lab.navigate_batch(queries, results, threads);
+      auto const seconds = timer.seconds();
+
+      auto const name = "batch.threads." + std::to_string(threads);
+      bench::report(name + ".queries", num_queries / seconds, "queries/s");
+      bench::report(name + ".steps", num_queries * route_length / seconds / 1e6, "Msteps/s");
+   }
+   return 0;
+}
@@ -0,0 +1,50 @@
+#include "bench.h"
+
+#include <cstdlib>
+
+
+/*
+ * Влияние labyrinth_t::optimize() на скорость навигации по секциям,
+ * загруженным в случайном порядке:
+ *    bench_locality [side] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 2000;
+   std::size_t const route_length = argc > 2 ? std::atol(argv[2]) : 10000000;
+
+   auto const board = bench::dense_board(side, side, 0.1, 1);
+   auto const route = bench::random_route(route_length, 2);
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "route: " << route.size() << " steps" << std::endl;
+
+   for (auto storage : {knossos::storage_compact, knossos::storage_bitmap})
+   {
+      std::string const name = bench::storage_name(storage);
+      knossos::labyrinth_t lab(board, boost::none, storage);
+
+      lab.set_position(board.front());
+      bench::timer_t shuffled_timer;
+      auto const shuffled_end = lab.navigate(route);
+      bench::report(name + ".navigate.shuffled",
+                    route.size() / shuffled_timer.seconds() / 1e6, "Msteps/s");
+
+      bench::timer_t optimize_timer;
+      lab.optimize();
+      bench::report(name + ".optimize", optimize_timer.seconds(), "s");
+
+      lab.set_position(board.front());
+      bench::timer_t ordered_timer;
+      auto const ordered_end = lab.navigate(route);
+      bench::report(name + ".navigate.morton",
+                    route.size() / ordered_timer.seconds() / 1e6, "Msteps/s");
+
+      if (shuffled_end.x != ordered_end.x || shuffled_end.y != ordered_end.y)
+      {
+         std::cerr << "routes diverged after optimize()" << std::endl;
+         return 1;
+      }
+   }
+   return 0;
+}
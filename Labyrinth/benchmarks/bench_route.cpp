@@ -0,0 +1,72 @@
+#include "bench.h"
+
+#include <boost/range/adaptor/transformed.hpp>
+
+#include <cstdlib>
+#include <functional>
+
+namespace ba = boost::adaptors;
+
+
+namespace
+{
+   knossos::direction_t char_to_dir(char ch)
+   {
+      switch (ch)
+      {
+      case 'u': return knossos::dir_up;
+      case 'd': return knossos::dir_down;
+      case 'l': return knossos::dir_left;
+      default:  return knossos::dir_right;
+      }
+   }
+}
+
+/*
+ * Шаги в секунду при передаче маршрута через any_range и через
+ * непрерывные массивы, а также с записью пройденного пути:
+ *    bench_route [side] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 300;
+   std::size_t const route_length = argc > 2 ? std::atol(argv[2]) : 20000000;
+
+   auto const board = bench::dense_board(side, side, 0.1, 1);
+   auto const route = bench::random_route(route_length, 2);
+
+   std::vector<std::uint8_t> codes(route.begin(), route.end());
+   std::string text;
+   for (auto dir : route)
+      text.push_back("uldr"[dir]);
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "route: " << route.size() << " steps" << std::endl;
+
+   for (auto storage : {knossos::storage_tree, knossos::storage_compact, knossos::storage_bitmap})
+   {
+      std::string const name = bench::storage_name(storage);
+      knossos::labyrinth_t lab(board, boost::none, storage);
+      lab.optimize();
+
+      auto const start = board.front();
+      auto measure = [&](std::string const & path, std::function<void()> const & navigate)
+      {
+         bench::timer_t timer;
+         navigate();
+         bench::report(name + "." + path, route.size() / timer.seconds() / 1e6, "Msteps/s");
+      };
+
+      measure("any_range.text", [&] { lab.navigate(text | ba::transformed(&char_to_dir), start); });
+      measure("any_range", [&] { lab.navigate(route, start); });
+      measure("pointer", [&] { lab.navigate(route.data(), route.data() + route.size(), start); });
+      measure("bytes", [&] { lab.navigate(codes.data(), codes.size(), start); });
+
+      // Случайный маршрут меняет направление почти на каждом шаге -
+      // худший случай для записи участками
+      knossos::route_trace_t trace;
+      lab.navigate(route.data(), route.data() + route.size(), trace, start);
+      measure("pointer.traced", [&] { lab.navigate(route.data(), route.data() + route.size(), trace, start); });
+   }
+   return 0;
+}
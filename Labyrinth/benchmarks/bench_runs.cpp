@@ -0,0 +1,51 @@
+#include "bench.h"
+
+#include <cstdlib>
+
+/*
+ * Маршрут с длинными сериями: пошаговая навигация против участков
+ * по индексу коридоров:
+ *    bench_runs [side] [runs] [run_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 1000;
+   std::size_t const num_runs = argc > 2 ? std::atol(argv[2]) : 100000;
+   std::size_t const run_length = argc > 3 ? std::atol(argv[3]) : 200;
+
+   auto const board = bench::dense_board(side, side, 0.002, 1);
+   auto const dirs = bench::random_route(num_runs, 2);
+
+   std::vector<knossos::direction_t> route;
+   route.reserve(num_runs * run_length);
+   for (auto dir : dirs)
+      route.insert(route.end(), run_length, dir);
+   auto const runs = knossos::encode_runs(route.data(), route.data() + route.size());
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "route: " << route.size() << " steps in " << runs.size() << " runs" << std::endl;
+
+   for (auto storage : {knossos::storage_compact, knossos::storage_bitmap})
+   {
+      std::string const name = bench::storage_name(storage);
+      knossos::labyrinth_t lab(board, boost::none, storage);
+      lab.optimize();
+      auto const start = board.front();
+
+      bench::timer_t steps_timer;
+      auto const expected = lab.navigate(route.data(), route.data() + route.size(), start);
+      bench::report(name + ".steps", route.size() / steps_timer.seconds() / 1e6, "Msteps/s");
+
+      bench::timer_t index_timer;
+      lab.navigate(runs.data(), runs.data(), start);
+      bench::report(name + ".runs.index", index_timer.seconds(), "s");
+
+      bench::timer_t runs_timer;
+      auto const end = lab.navigate(runs.data(), runs.data() + runs.size(), start);
+      bench::report(name + ".runs", route.size() / runs_timer.seconds() / 1e6, "Msteps/s");
+
+      if (end.x != expected.x || end.y != expected.y)
+         std::cout << name << ": results differ" << std::endl;
+   }
+   return 0;
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+
+#include <cstdlib>
+
+
+namespace
+{
+   knossos::storage_type_t const storages[] =
+   {
+      knossos::storage_tree,
+      knossos::storage_hash,
+      knossos::storage_bitmap,
+      knossos::storage_compact,
+      knossos::storage_versioned
+   };
+}
+
+/*
+ * Сравнение способов хранения секций:
+ *    bench_storage [side] [route_length]
+ */
+int main(int argc, char * argv[])
+{
+   int const side = argc > 1 ? std::atoi(argv[1]) : 1000;
+   std::size_t const route_length = argc > 2 ? std::atol(argv[2]) : 10000000;
+
+   auto const board = bench::dense_board(side, side, 0.1, 1);
+   auto const route = bench::random_route(route_length, 2);
+
+   std::cout << "board: " << board.size() << " sections, "
+             << "route: " << route.size() << " steps" << std::endl;
+
+   for (auto storage : storages)
+   {
+      std::string const name = bench::storage_name(storage);
+
+      {
+         bench::timer_t build_timer;
+         knossos::labyrinth_t lab(storage);
+         lab.add_sections(board);
+         bench::report(name + ".build.incremental", build_timer.seconds(), "s");
+      }
+
+      bench::timer_t build_timer;
+      knossos::labyrinth_t lab(storage);
+      lab.add_sections(std::vector<knossos::position_t>(board), 0);
+      bench::report(name + ".build.bulk", build_timer.seconds(), "s");
+
+      bench::timer_t find_timer;
+      std::size_t found = 0;
+      for (auto const & pos : board)
+         found += lab.set_position(pos) ? 1 : 0;
+      bench::report(name + ".find", find_timer.seconds() * 1e9 / found, "ns/lookup");
+
+      lab.set_position(board.front());
+      bench::timer_t route_timer;
+      auto const end = lab.navigate(route);
+      bench::report(name + ".navigate", route.size() / route_timer.seconds() / 1e6, "Msteps/s");
+
+      std::cout << name << ".end: (" << end.x << "," << end.y << ")" << std::endl;
+   }
+   return 0;
+}
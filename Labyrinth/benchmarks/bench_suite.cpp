@@ -0,0 +1,251 @@
+#include "bench.h"
+#include "generator.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+
+namespace
+{
+   /// Байты, выделенные через operator new и ещё не освобождённые
+   std::atomic<std::int64_t> live_bytes(0);
+
+   /// Перед блоком хранится его размер, выравнивание блока не меняется
+   std::size_t const header_size = 16;
+
+   void * counted_alloc(std::size_t size)
+   {
+      auto const block = static_cast<char *>(std::malloc(size + header_size));
+      if (!block)
+         return nullptr;
+      *reinterpret_cast<std::size_t *>(block) = size;
+      live_bytes.fetch_add(std::int64_t(size), std::memory_order_relaxed);
+      return block + header_size;
+   }
+
+   void counted_free(void * ptr)
+   {
+      if (!ptr)
+         return;
+      auto const block = static_cast<char *>(ptr) - header_size;
+      live_bytes.fetch_sub(std::int64_t(*reinterpret_cast<std::size_t *>(block)),
+                           std::memory_order_relaxed);
+      std::free(block);
+   }
+
+   knossos::storage_type_t const storages[] =
+   {
+      knossos::storage_tree,
+      knossos::storage_hash,
+      knossos::storage_bitmap,
+      knossos::storage_compact,
+      knossos::storage_versioned
+   };
+
+   struct result_t
+   {
+      char const *   kind;
+      char const *   storage;
+      std::size_t    sections;
+      double         build;             ///< с
+      double         bytes_per_section;
+      double         navigate;          ///< шагов/с
+      double         remove;            ///< секций/с
+      double         save;              ///< с
+      double         load;              ///< с
+   };
+
+   result_t measure(bench::board_kind_t kind, knossos::storage_type_t storage,
+                    std::vector<knossos::position_t> const & board,
+                    std::vector<knossos::direction_t> const & route,
+                    boost::filesystem::path const & state_path)
+   {
+      result_t result{};
+      result.kind     = bench::board_kind_name(kind);
+      result.storage  = bench::storage_name(storage);
+      result.sections = board.size();
+
+      // Память лабиринта - прирост занятой кучи после построения,
+      // рабочий буфер пакетного добавления к тому времени освобождён,
+      // однократные выделения процесса сделаны заранее (см. warm_up)
+      auto const baseline = live_bytes.load();
+      knossos::labyrinth_t lab(storage);
+      {
+         std::vector<knossos::position_t> sections(board);
+         bench::timer_t timer;
+         lab.add_sections(std::move(sections), 0);
+         result.build = timer.seconds();
+      }
+      result.bytes_per_section = double(live_bytes.load() - baseline) / board.size();
+
+      lab.set_position(board.front());
+      {
+         bench::timer_t timer;
+         lab.navigate(route);
+         result.navigate = route.size() / timer.seconds();
+      }
+
+      {
+         bench::timer_t timer;
+         lab.save(state_path.string());
+         result.save = timer.seconds();
+      }
+      {
+         knossos::labyrinth_t loaded(storage);
+         bench::timer_t timer;
+         loaded.load(state_path.string());
+         result.load = timer.seconds();
+      }
+      boost::filesystem::remove(state_path);
+
+      // Удаляется случайная десятая часть секций (лабиринт перемешан)
+      std::vector<knossos::position_t> const removed(board.begin(),
+                                                     board.begin() + (board.size() + 9) / 10);
+      {
+         bench::timer_t timer;
+         lab.remove_sections(removed);
+         result.remove = removed.size() / timer.seconds();
+      }
+      return result;
+   }
+
+   /// Выделения на всё время работы процесса (общий пул потоков, буферы
+   /// потоков вывода и т.п.) делаются прогоном всех замеров на малом
+   /// лабиринте до первого замера памяти
+   void warm_up(std::vector<knossos::direction_t> const & route,
+                boost::filesystem::path const & state_path)
+   {
+      auto const kind = bench::board_kinds[0];
+      auto const board = bench::generate_board(kind, 1000, 1);
+      for (auto storage : storages)
+         measure(kind, storage, board, route, state_path);
+   }
+
+   std::string to_json(std::vector<result_t> const & results, std::size_t route_length,
+                       unsigned seed)
+   {
+      std::ostringstream out;
+      out << "{\n"
+          << "  \"seed\": " << seed << ",\n"
+          << "  \"route_length\": " << route_length << ",\n"
+          << "  \"results\": [";
+      for (std::size_t i = 0; i != results.size(); ++i)
+      {
+         auto const & r = results[i];
+         out << (i ? ",\n" : "\n")
+             << "    {\"kind\": \"" << r.kind << "\", \"storage\": \"" << r.storage << "\""
+             << ", \"sections\": " << r.sections
+             << ", \"build_s\": " << r.build
+             << ", \"bytes_per_section\": " << r.bytes_per_section
+             << ", \"navigate_steps_per_s\": " << r.navigate
+             << ", \"remove_sections_per_s\": " << r.remove
+             << ", \"save_s\": " << r.save
+             << ", \"load_s\": " << r.load << "}";
+      }
+      out << "\n  ]\n}\n";
+      return out.str();
+   }
+}
+
+void * operator new(std::size_t size)
+{
+   if (auto const ptr = counted_alloc(size))
+      return ptr;
+   throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+   return operator new(size);
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+   return counted_alloc(size);
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+   return counted_alloc(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+   counted_free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+   counted_free(ptr);
+}
+
+void operator delete(void * ptr, std::nothrow_t const &) noexcept
+{
+   counted_free(ptr);
+}
+
+void operator delete[](void * ptr, std::nothrow_t const &) noexcept
+{
+   counted_free(ptr);
+}
+
+/*
+ * Набор замеров для отслеживания производительности: для каждого вида
+ * лабиринта (dense, sparse, maze), размера от 10^3 до max_sections секций
+ * и способа хранения - построение, память на секцию, navigate, сохранение
+ * и загрузка состояния, remove_sections:
+ *    bench_suite [max_sections] [route_length] [seed] [results.json]
+ * Результаты печатаются таблицей и, если задан файл, пишутся в него в JSON
+ */
+int main(int argc, char * argv[])
+{
+   std::uint64_t const max_sections = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+   std::size_t const route_length = argc > 2 ? std::atol(argv[2]) : 10000000;
+   auto const seed = unsigned(argc > 3 ? std::atoi(argv[3]) : 1);
+   std::string const json_path = argc > 4 ? argv[4] : "";
+
+   auto const state_path = boost::filesystem::temp_directory_path()
+                         / boost::filesystem::unique_path("bench_suite-%%%%-%%%%.state");
+   auto const route = bench::random_route(route_length, seed);
+   warm_up(route, state_path);
+
+   std::vector<result_t> results;
+   for (auto kind : bench::board_kinds)
+      for (std::uint64_t count = 1000; count <= max_sections; count *= 10)
+      {
+         auto const board = bench::generate_board(kind, count, seed);
+         std::cout << bench::board_kind_name(kind) << " board: "
+                   << board.size() << " sections" << std::endl;
+
+         for (auto storage : storages)
+         {
+            auto const r = measure(kind, storage, board, route, state_path);
+            std::string const name = std::string(r.kind) + "." + std::to_string(count)
+                                   + "." + r.storage;
+            bench::report(name + ".build", r.sections / r.build / 1e6, "Msections/s");
+            bench::report(name + ".memory", r.bytes_per_section, "bytes/section");
+            bench::report(name + ".navigate", r.navigate / 1e6, "Msteps/s");
+            bench::report(name + ".save", r.save * 1e3, "ms");
+            bench::report(name + ".load", r.load * 1e3, "ms");
+            bench::report(name + ".remove", r.remove / 1e6, "Msections/s");
+            results.push_back(r);
+         }
+      }
+
+   if (!json_path.empty())
+   {
+      std::ofstream json(json_path);
+      json << to_json(results, route_length, seed);
+      if (!json)
+      {
+         std::cerr << "failed to write " << json_path << std::endl;
+         return 1;
+      }
+   }
+   return 0;
+}
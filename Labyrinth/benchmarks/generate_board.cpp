@@ -0,0 +1,139 @@
+#include "generator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+
+namespace
+{
+   typedef std::unique_ptr<std::FILE, int (*)(std::FILE *)> file_t;
+
+   file_t open_file(char const * path)
+   {
+      file_t file(std::fopen(path, "wb"), &std::fclose);
+      if (!file)
+         throw std::runtime_error(std::string("failed to open file ") + path);
+      return file;
+   }
+
+   char * write_int(char * out, int value)
+   {
+      char digits[16];
+      char * last = digits;
+      unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+      do
+      {
+         *last++ = char('0' + magnitude % 10);
+         magnitude /= 10;
+      } while (magnitude != 0);
+
+      if (value < 0)
+         *out++ = '-';
+      while (last != digits)
+         *out++ = *--last;
+      return out;
+   }
+
+   char dir_char(knossos::direction_t dir)
+   {
+      switch (dir)
+      {
+      case knossos::dir_up:    return 'u';
+      case knossos::dir_left:  return 'l';
+      case knossos::dir_down:  return 'd';
+      case knossos::dir_right: return 'r';
+      default:                 return '?';
+      }
+   }
+
+   /// Лабиринт в текстовом формате ariadne, по 8 секций в строке
+   void write_board(std::vector<knossos::position_t> const & board, char const * path)
+   {
+      auto const file = open_file(path);
+      std::vector<char> buffer(1 << 20);
+      char * out = buffer.data();
+      for (std::size_t i = 0; i != board.size(); ++i)
+      {
+         if (buffer.data() + buffer.size() - out < 64)
+         {
+            std::fwrite(buffer.data(), 1, std::size_t(out - buffer.data()), file.get());
+            out = buffer.data();
+         }
+         *out++ = '(';
+         out = write_int(out, board[i].x);
+         *out++ = ',';
+         *out++ = ' ';
+         out = write_int(out, board[i].y);
+         *out++ = ')';
+         if (i + 1 != board.size())
+            *out++ = ',';
+         *out++ = (i % 8 == 7 || i + 1 == board.size()) ? '\n' : ' ';
+      }
+      std::fwrite(buffer.data(), 1, std::size_t(out - buffer.data()), file.get());
+      if (std::ferror(file.get()))
+         throw std::runtime_error(std::string("failed to write file ") + path);
+   }
+
+   /// Случайный маршрут символами udlr, тот же, что и bench::random_route
+   /// с тем же seed, но без хранения в памяти
+   void write_route(std::uint64_t length, unsigned seed, char const * path)
+   {
+      auto const file = open_file(path);
+      std::mt19937 gen(seed);
+      std::uniform_int_distribution<int> dir(0, knossos::total_num - 1);
+
+      std::vector<char> buffer(1 << 20);
+      while (length != 0)
+      {
+         auto const size = std::size_t(std::min<std::uint64_t>(length, buffer.size()));
+         for (std::size_t i = 0; i != size; ++i)
+            buffer[i] = dir_char(knossos::direction_t(dir(gen)));
+         std::fwrite(buffer.data(), 1, size, file.get());
+         length -= size;
+      }
+      std::fputc('\n', file.get());
+      if (std::ferror(file.get()))
+         throw std::runtime_error(std::string("failed to write file ") + path);
+   }
+}
+
+/*
+ * Синтетический лабиринт и маршрут для ariadne (--board, --route-file):
+ *    generate_board dense|sparse|maze sections seed board.txt [route.txt route_length]
+ * Двоичный лабиринт получается из текстового через ariadne --convert
+ */
+int main(int argc, char * argv[])
+{
+   if (argc != 5 && argc != 7)
+   {
+      std::cerr << "usage: generate_board dense|sparse|maze sections seed board.txt "
+                   "[route.txt route_length]" << std::endl;
+      return 1;
+   }
+
+   try
+   {
+      auto const kind = bench::parse_board_kind(argv[1]);
+      std::uint64_t const count = std::strtoull(argv[2], nullptr, 10);
+      auto const seed = unsigned(std::strtoul(argv[3], nullptr, 10));
+
+      auto const board = bench::generate_board(kind, count, seed);
+      write_board(board, argv[4]);
+      std::cout << "board: " << board.size() << " sections" << std::endl;
+
+      if (argc == 7)
+      {
+         std::uint64_t const length = std::strtoull(argv[6], nullptr, 10);
+         write_route(length, seed, argv[5]);
+         std::cout << "route: " << length << " steps" << std::endl;
+      }
+   }
+   catch (std::exception const & e)
+   {
+      std::cerr << e.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
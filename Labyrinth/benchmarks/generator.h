@@ -0,0 +1,121 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace bench
+{
+   /// Вид синтетического лабиринта
+   enum board_kind_t
+   {
+      board_dense,    ///< квадрат, из которого выброшена десятая часть секций
+      board_sparse,   ///< квадрат, в котором занята десятая часть секций
+      board_maze      ///< совершенный лабиринт из коридоров шириной в секцию
+   };
+
+   board_kind_t const board_kinds[] = { board_dense, board_sparse, board_maze };
+
+   inline char const * board_kind_name(board_kind_t kind)
+   {
+      switch (kind)
+      {
+      case board_dense:  return "dense";
+      case board_sparse: return "sparse";
+      case board_maze:   return "maze";
+      }
+      return "unknown";
+   }
+
+   inline board_kind_t parse_board_kind(std::string const & name)
+   {
+      for (auto kind : board_kinds)
+         if (name == board_kind_name(kind))
+            return kind;
+      throw std::invalid_argument("unknown board kind: " + name);
+   }
+
+   /*!
+    * \brief Секции лабиринта вида kind примерно из count секций
+    * \param emit вызывается для каждой секции, f(x, y), по столбцам
+    *
+    * Лабиринт не хранится, так что размер ограничен только временем.
+    * Квадраты заполняются пропусками по геометрическому распределению,
+    * а не броском для каждой клетки, поэтому редкий лабиринт строится
+    * так же быстро, как плотный. Лабиринт строится алгоритмом
+    * "sidewinder" по одному ряду клеток: клетки - секции с чётными
+    * координатами, проходы между ними - секции между клетками, всего
+    * 2 w h - 1 секций. Координаты сдвинуты так, чтобы центр был в нуле.
+    */
+   template <class Emit>
+   void generate_sections(board_kind_t kind, std::uint64_t count, unsigned seed, Emit && emit)
+   {
+      std::mt19937_64 gen(seed);
+      if (kind == board_maze)
+      {
+         auto const side = std::max<int>(1, int(std::ceil(std::sqrt(count / 2.0))));
+         std::bernoulli_distribution close_run(0.5);
+
+         // Нижний ряд - сплошной коридор
+         for (int x = 0; x < side; ++x)
+         {
+            emit(2 * x - side, -side);
+            if (x + 1 != side)
+               emit(2 * x + 1 - side, -side);
+         }
+
+         // В остальных рядах клетка либо продолжает серию проходом направо,
+         // либо закрывает её проходом вниз из случайной клетки серии
+         for (int y = 1; y < side; ++y)
+         {
+            int run_start = 0;
+            for (int x = 0; x < side; ++x)
+            {
+               emit(2 * x - side, 2 * y - side);
+               if (x + 1 == side || close_run(gen))
+               {
+                  std::uniform_int_distribution<int> cell(run_start, x);
+                  emit(2 * cell(gen) - side, 2 * y - 1 - side);
+                  run_start = x + 1;
+               }
+               else
+                  emit(2 * x + 1 - side, 2 * y - side);
+            }
+         }
+         return;
+      }
+
+      double const density = kind == board_dense ? 0.9 : 0.1;
+      auto const side = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(std::sqrt(count / density))));
+      auto const cells = side * side;
+      auto const half = int(side / 2);
+
+      std::geometric_distribution<std::uint64_t> gap(density);
+      for (auto cell = gap(gen); cell < cells; cell += 1 + gap(gen))
+         emit(int(cell / side) - half, int(cell % side) - half);
+   }
+
+   /// Секции лабиринта вида kind, перемешанные, как в файле,
+   /// записанном в произвольном порядке
+   inline std::vector<knossos::position_t> generate_board(board_kind_t kind, std::uint64_t count,
+                                                          unsigned seed)
+   {
+      std::vector<knossos::position_t> board;
+      board.reserve(std::size_t(count + count / 8));
+      generate_sections(kind, count, seed, [&board](int x, int y)
+      {
+         board.emplace_back(x, y);
+      });
+
+      std::mt19937 gen(seed);
+      std::shuffle(board.begin(), board.end(), gen);
+      return board;
+   }
+}
@@ -0,0 +1,79 @@
+/*!
+\file
+\brief Одновременное движение множества агентов по одной карте
+*/
+
+#pragma once
+
+#include <knossos/snapshot.h>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Агенты со своими маршрутами на общем снимке карты
+    *
+    * Секции снимка нумеруются подряд, соседи хранятся таблицей по четыре
+    * номера на секцию (шаг в стену оставляет номер прежним). Номера секций
+    * агентов и положения в маршрутах лежат отдельными массивами (структура
+    * массивов), поэтому за такт шаг делают сразу несколько агентов: при
+    * сборке с AVX2 (опция WITH_AVX2) - по восемь, выборкой gather из
+    * маршрутов и таблицы соседей, иначе - скалярным циклом без ветвлений.
+    * Агенты независимы, так что они делятся между потоками, и каждый поток
+    * проходит все такты своей части без синхронизации.
+    *
+    * Объект следует использовать из одного потока.
+    */
+   class KNOSSOS_EXPORT agents_t
+   {
+   public:
+      /*!
+       * \brief Пустой набор агентов
+       * \param map снимок карты
+       * \param num_threads число потоков, 0 - по числу ядер
+       */
+      explicit agents_t(snapshot_t const & map, unsigned num_threads = 0);
+      ~agents_t();
+
+      /*!
+       * \brief Добавляет агента
+       * \param start начальные координаты
+       * \param first, last маршрут агента (копируется)
+       * \return номер агента
+       * \throw position_error_t если секции с координатами start нет
+       * \throw route_error_t если направление в маршруте некорректно
+       * \throw std::length_error если маршруты всех агентов
+       *                          в сумме длиннее 2^31 шагов
+       */
+      std::size_t add(position_t const & start,
+                      direction_t const * first, direction_t const * last);
+
+      /// Количество агентов
+      std::size_t size() const;
+
+      /// Количество агентов, маршрут которых ещё не закончился
+      std::size_t active() const;
+
+      /*!
+       * \brief Продвигает всех агентов на ticks тактов
+       * \return количество агентов, маршрут которых ещё не закончился
+       *
+       * За такт каждый агент делает очередной шаг своего маршрута,
+       * агент с законченным маршрутом стоит на месте
+       */
+      std::size_t advance(std::uint64_t ticks = 1);
+
+      /// Текущие координаты агента
+      position_t position(std::size_t agent) const;
+
+      /// Текущие координаты всех агентов по порядку номеров
+      void positions(std::vector<position_t> & out) const;
+
+      /// Сколько шагов маршрута агента осталось
+      std::uint64_t remaining(std::size_t agent) const;
+
+   private:
+      struct impl_t;
+      std::unique_ptr<impl_t> pimpl_;
+   };
+}
@@ -0,0 +1,91 @@
+/*!
+\file
+\brief Прогон маршрута сразу из всех секций по битовой карте
+*/
+
+#pragma once
+
+#include <knossos/snapshot.h>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Плотная битовая карта снимка для прогона маршрута из всех секций
+    *
+    * Карта покрывает описанный прямоугольник секций, строка прямоугольника -
+    * несколько 64-битных слов. "Шагающие" тоже хранятся битовой картой, и
+    * каждый шаг маршрута применяется ко всем сразу сдвигами и масками
+    * слов: шагающий, перед которым нет секции, остаётся на месте.
+    * Шаг стоит O(площадь / 64) операций над словами вместо обхода
+    * по указателям из каждой секции.
+    *
+    * Память - около 7 бит на клетку прямоугольника, поэтому карта
+    * рассчитана на плотные лабиринты. Константные методы можно вызывать
+    * одновременно из разных потоков.
+    */
+   class KNOSSOS_EXPORT bitboard_t
+   {
+   public:
+      /*!
+       * \brief Битовая карта снимка
+       * \param map снимок карты
+       * \param num_threads число потоков для шагов по большой карте,
+       *                    0 - по числу ядер
+       */
+      explicit bitboard_t(snapshot_t const & map, unsigned num_threads = 0);
+      ~bitboard_t();
+
+      /// Левый нижний угол описанного прямоугольника
+      position_t origin() const;
+
+      /// Ширина описанного прямоугольника
+      std::size_t width() const;
+
+      /// Высота описанного прямоугольника
+      std::size_t height() const;
+
+      /*!
+       * \brief Секции, занятые после прохождения маршрута из всех секций
+       * \param first, last границы массива направлений
+       * \return координаты по строкам снизу вверх, в строке - слева направо
+       */
+      std::vector<position_t> occupied(direction_t const * first,
+                                       direction_t const * last) const;
+
+      /*!
+       * \brief Секции, занятые после прохождения маршрута из starts
+       *
+       * Начальные координаты вне карты пропускаются
+       */
+      std::vector<position_t> occupied(std::vector<position_t> const & starts,
+                                       direction_t const * first,
+                                       direction_t const * last) const;
+
+      /*!
+       * \brief Все начальные секции, из которых маршрут заканчивается в targets
+       *
+       * Множество targets проходится по маршруту в обратную сторону,
+       * с той же стоимостью шага, что и occupied
+       */
+      std::vector<position_t> reaching(std::vector<position_t> const & targets,
+                                       direction_t const * first,
+                                       direction_t const * last) const;
+
+      /*!
+       * \brief Конечная точка маршрута для каждой секции
+       * \param starts все секции в порядке occupied()
+       * \param ends конечные точки, ends[i] - для starts[i]
+       * \throw std::length_error если в прямоугольнике больше 2^32 клеток
+       *
+       * Номер конечной клетки хранится для каждой клетки прямоугольника
+       * (4 байта) и протягивается по маршруту от конца к началу
+       */
+      void mapping(direction_t const * first, direction_t const * last,
+                   std::vector<position_t> & starts, std::vector<position_t> & ends) const;
+
+   private:
+      struct impl_t;
+      std::unique_ptr<impl_t> pimpl_;
+   };
+}
@@ -0,0 +1,91 @@
+/*!
+\file
+\brief Маршрут, скомпилированный в таблицу переходов между секциями
+*/
+
+#pragma once
+
+#include <knossos/snapshot.h>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Маршрут как функция "начальная секция -> конечная секция"
+    *
+    * Маршрут один раз проходится из каждой секции снимка, результат
+    * хранится таблицей по 4 байта на секцию. После этого применение
+    * маршрута - одно обращение к таблице, а k-кратное применение -
+    * O(log k) обращений по таблицам удвоения (маршрут, повторённый
+    * 2, 4, 8, ... раз). Таблицы удвоения строятся по мере надобности
+    * и занимают ещё 4 байта на секцию каждая.
+    *
+    * Копирование дешёвое, копии разделяют таблицы. Все константные
+    * методы можно вызывать одновременно из разных потоков.
+    */
+   class KNOSSOS_EXPORT compiled_route_t
+   {
+   public:
+      /// Длина предпериода и длина цикла последовательности положений
+      struct cycle_t
+      {
+         std::uint64_t tail;    ///< сколько применений до входа в цикл
+         std::uint64_t length;  ///< через сколько применений положение повторяется
+      };
+
+      /*!
+       * \brief Компиляция маршрута
+       * \param map снимок карты
+       * \param first, last границы массива направлений
+       * \param num_threads число потоков, 0 - по числу ядер
+       */
+      compiled_route_t(snapshot_t const & map,
+                       direction_t const * first, direction_t const * last,
+                       unsigned num_threads = 0);
+
+      /*!
+       * \brief Компиляция маршрута из участков (см. route_run_t)
+       * \throw route_error_t если направление участка некорректно
+       */
+      compiled_route_t(snapshot_t const & map,
+                       route_run_t const * first, route_run_t const * last,
+                       unsigned num_threads = 0);
+
+      ~compiled_route_t();
+
+      /// Снимок, для которого скомпилирован маршрут
+      snapshot_t const & map() const;
+
+      /*!
+       * \brief Конечная точка маршрута, пройденного times раз подряд
+       * \return boost::none если секции start нет на карте
+       */
+      boost::optional<position_t> apply(position_t const & start,
+                                        std::uint64_t times = 1) const;
+
+      /*!
+       * \brief Маршрут "сначала этот, затем next"
+       * \throw std::invalid_argument если маршруты скомпилированы
+       *                              для разных снимков
+       */
+      compiled_route_t then(compiled_route_t const & next) const;
+
+      /// Маршрут, повторённый times раз (times > 0)
+      compiled_route_t power(std::uint64_t times) const;
+
+      /*!
+       * \brief Поиск цикла при многократном применении маршрута из start
+       * \return boost::none если секции start нет на карте
+       *
+       * Время пропорционально tail + length, дополнительной памяти нет
+       */
+      boost::optional<cycle_t> cycle(position_t const & start) const;
+
+   private:
+      struct impl_t;
+
+      explicit compiled_route_t(std::shared_ptr<impl_t const> impl);
+
+      std::shared_ptr<impl_t const> pimpl_;
+   };
+}
@@ -12,6 +12,9 @@
 
 #include <memory>
 #include <exception>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 
 namespace knossos
@@ -39,6 +42,24 @@ namespace knossos
       total_num
    };
 
+   /// Способ хранения секций внутри лабиринта
+   enum storage_type_t
+   {
+      storage_tree,    ///< упорядоченное дерево с указателями на соседей
+      storage_hash,    ///< хеш-таблица с открытой адресацией по координатам
+      storage_bitmap,  ///< битовые блоки 64x64, около бита на секцию плотного лабиринта
+      storage_compact,   ///< непрерывный массив секций с номерами соседей
+      storage_versioned  ///< битовые блоки в постоянном дереве: копия карты
+                         ///< разделяет блоки, правка копирует только свой путь
+   };
+
+   /// Алгоритм поиска кратчайшего маршрута
+   enum search_algorithm_t
+   {
+      search_bfs,   ///< поиск в ширину
+      search_astar  ///< A* с манхэттенским расстоянием до цели
+   };
+
    template <class Value, class Tag = boost::bidirectional_traversal_tag>
    struct values_range_t
    {
@@ -57,6 +78,45 @@ namespace knossos
       values_range_t<position_t>::type
       positions_range_t;
 
+   /// Запрос пакетной навигации: маршрут из непрерывного массива
+   struct route_query_t
+   {
+      position_t          start;   ///< начальные координаты маршрута
+      direction_t const * route;   ///< первое направление маршрута
+      std::size_t         length;  ///< количество направлений
+   };
+
+   /// Участок маршрута: count шагов подряд в направлении dir
+   struct route_run_t
+   {
+      direction_t   dir;
+      std::uint64_t count;
+   };
+
+   /// Участок пройденного пути: из секции start count шагов подряд в направлении dir
+   struct trace_run_t
+   {
+      position_t    start;
+      direction_t   dir;
+      std::uint64_t count;
+   };
+
+   /// Пройденный путь, который заполняет навигация с трассировкой
+   struct route_trace_t
+   {
+      std::vector<trace_run_t> runs;         ///< участки пути по порядку
+      std::uint64_t            blocked = 0;  ///< число шагов в стену
+   };
+
+   /// Прямоугольник на плоскости, границы включаются
+   struct region_t
+   {
+      position_t low;   ///< левый нижний угол
+      position_t high;  ///< правый верхний угол
+   };
+
+   class snapshot_t;
+
    ////////////////////////////////////////////////////////////////////////////
 
    /*!
@@ -66,6 +126,20 @@ namespace knossos
    {
    };
 
+   /*!
+    * \brief Исключение при некорректном маршруте
+    */
+   struct route_error_t : std::exception
+   {
+   };
+
+   /*!
+    * \brief Исключение при сохранении или загрузке состояния лабиринта
+    */
+   struct state_error_t : std::exception
+   {
+   };
+
    /*!
     *  \brief Класс, реализующий функционал "навигации по лабиринту"
     *
@@ -83,15 +157,29 @@ namespace knossos
       labyrinth_t();
       ~labyrinth_t();
 
+      /*!
+       * \brief Создание пустого лабиринта с заданным способом хранения
+       * \param storage способ хранения секций
+       */
+      explicit labyrinth_t(storage_type_t storage);
+
       /*!
        * \brief Создание лабиринта с помощью конструктора
-       * \param sections последовательность координат секций лабиринта
+       * \param sections последовательность координат секций лабиринта,
+       *                 добавляются пакетно (см. add_sections)
        * \param start_position текущее положение
+       * \param storage способ хранения секций
        * \throw position_error_t если секция с координатами текущего
        *                         положения отсутствует в последовательности
        */
       labyrinth_t(positions_range_t sections,
-                  boost::optional<position_t> const & start_position = boost::none);
+                  boost::optional<position_t> const & start_position = boost::none,
+                  storage_type_t storage = storage_tree);
+
+      /*!
+       * \brief Возвращает способ хранения секций
+       */
+      storage_type_t storage() const;
 
       /*!
        * \brief Добавляет новые секции в лабиринт
@@ -99,6 +187,40 @@ namespace knossos
        */
       void add_sections(positions_range_t sections);
 
+      /*!
+       * \brief Пакетно добавляет новые секции в лабиринт
+       * \param sections координаты (вектор используется как рабочий буфер)
+       * \param num_threads число потоков, 0 - по числу ядер
+       *
+       * Для хранилищ со ссылками на соседей (storage_tree, storage_compact)
+       * координаты один раз сортируются, повторы отбрасываются, а соседи
+       * в пустом лабиринте связываются линейными проходами по столбцам,
+       * без поиска каждой соседней секции. Сортировка и связывание
+       * выполняются в num_threads потоках.
+       */
+      void add_sections(std::vector<position_t> && sections, unsigned num_threads = 1);
+
+      /*!
+       * \brief Добавляет секции из непрерывного массива
+       * \param first, last границы массива координат
+       *
+       * То же, что add_sections(positions_range_t), но без обращений
+       * к элементам через стирание типа
+       */
+      void add_sections(position_t const * first, position_t const * last);
+
+      /*!
+       * \brief Готовит место под count секций
+       * \param count ожидаемое общее количество секций
+       *
+       * Имеет смысл перед добавлением секций несколькими пакетами, когда
+       * их общее количество известно заранее: storage_hash и storage_compact
+       * тогда не перестраивают таблицу и не копируют массив секций при
+       * росте. Набор секций не меняется, но, как и изменения, отделяет
+       * лабиринт от снимков и увеличивает версию карты.
+       */
+      void reserve(std::size_t count);
+
       /*!
        * \brief Удаляет секций из лабиринта
        * \param sections
@@ -108,12 +230,119 @@ namespace knossos
        */
       void remove_sections(positions_range_t sections);
 
+      /*!
+       * \brief Перестраивает внутреннее представление для быстрой навигации
+       *
+       * Имеет смысл вызывать один раз после загрузки всех секций.
+       * Для storage_compact секции раскладываются в памяти вдоль кривой
+       * Мортона (соседи на плоскости оказываются рядом в памяти) и
+       * удаляются надгробия, для storage_bitmap так же упорядочиваются
+       * блоки. Набор секций и текущая позиция не меняются.
+       */
+      void optimize();
+
+      /*!
+       * \brief Сохраняет лабиринт в файл
+       * \param path путь к файлу (перезаписывается)
+       * \throw state_error_t если файл не удалось записать
+       *
+       * Файл содержит способ хранения, текущее положение и секции в
+       * версионированном двоичном формате с контрольной суммой.
+       * storage_compact и storage_hash пишут внутреннее представление
+       * целиком, вместе со связями между секциями в виде номеров,
+       * остальные способы хранения - только координаты секций.
+       */
+      void save(std::string const & path) const;
+
+      /*!
+       * \brief Заменяет лабиринт содержимым файла, записанного save()
+       * \param path путь к файлу
+       * \throw state_error_t если файла нет, он другого формата или версии,
+       *                      либо повреждён; лабиринт тогда не меняется
+       *
+       * Файл отображается в память. Формат и версия проверяются по заголовку,
+       * повреждение - по размеру и контрольной сумме, прежде чем данные
+       * будут прочитаны. Для storage_compact и storage_hash секции
+       * копируются массивами без повторного связывания, остальные
+       * способы хранения строятся пакетным добавлением.
+       * Способ хранения берётся из файла, версия карты увеличивается.
+       */
+      void load(std::string const & path);
+
       /*!
        * \brief Возвращает координаты секций
        * \return
+       *
+       * Порядок секций зависит от способа хранения
        */
       positions_range_t sections() const;
 
+      /*!
+       * \brief Секции прямоугольника
+       * \param region прямоугольник
+       * \param out координаты секций по строкам снизу вверх, в строке - слева
+       *            направо (содержимое заменяется, память переиспользуется)
+       *
+       * Запросы к областям используют индекс коридоров по строкам: он
+       * строится при первом запросе и сбрасывается при изменении карты.
+       * Каждая непустая строка области находится двоичным поиском, так что
+       * время зависит от числа строк и найденных секций, а не от размера карты.
+       */
+      void sections_in(region_t const & region, std::vector<position_t> & out) const;
+
+      /// Количество секций прямоугольника, без перечисления каждой
+      std::uint64_t count_in(region_t const & region) const;
+
+      /// Секции не дальше radius от center по евклидову расстоянию, см. sections_in
+      void sections_within(position_t const & center, std::uint32_t radius,
+                           std::vector<position_t> & out) const;
+
+      /// Количество секций не дальше radius от center
+      std::uint64_t count_within(position_t const & center, std::uint32_t radius) const;
+
+      /*!
+       * \brief Неизменяемый снимок текущей карты лабиринта
+       *
+       * Снимок разделяет секции с лабиринтом. При следующем изменении
+       * лабиринт сначала копирует секции, а снимок остаётся прежним.
+       * По снимку могут одновременно перемещаться курсоры cursor_t
+       * из разных потоков. Сам labyrinth_t, включая этот метод, следует
+       * использовать из одного потока (кроме published()).
+       * Объявление - в knossos/snapshot.h
+       *
+       * Для storage_versioned копирование при изменении затрагивает только
+       * блоки, которые меняются, и не зависит от размера карты; остальные
+       * способы хранения копируют карту целиком.
+       */
+      snapshot_t snapshot() const;
+
+      /*!
+       * \brief Публикует текущую версию карты для других потоков
+       *
+       * Опубликованную версию возвращает published(), пока не будет
+       * опубликована следующая. Лабиринт продолжает меняться независимо
+       * от неё, как и от любого снимка.
+       */
+      void publish();
+
+      /*!
+       * \brief Последняя опубликованная версия карты
+       *
+       * Единственный метод, который можно вызывать из любого потока
+       * одновременно с изменением лабиринта. Полученный снимок остаётся
+       * неизменным, пока существует. До первого вызова publish()
+       * опубликована пустая карта версии 0.
+       */
+      snapshot_t published() const;
+
+      /*!
+       * \brief Номер версии карты
+       *
+       * Начинается с 0 и увеличивается при каждом изменении карты
+       * (add_sections, remove_sections, optimize, reserve, load)
+       */
+      std::uint64_t version() const;
+
       /*!
        * \brief Позволяет узнать, задана ли текущая позция внутри лабиринта
        * \return true eсли позиция задана, иначе false
@@ -155,8 +384,118 @@ namespace knossos
       position_t const & navigate(directions_range_t route,
          boost::optional<position_t> const & start_position = boost::none);
 
+      /*!
+       * \brief Навигация по маршруту из непрерывного массива
+       * \param first, last границы массива направлений
+       * \param start_position начальные координаты маршрута
+       * \return конечная точка маршрута
+       *
+       * Аналог navigate(directions_range_t), в котором цикл по маршруту
+       * не проходит через стирание типа и целиком встраивается
+       */
+      position_t const & navigate(direction_t const * first, direction_t const * last,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /*!
+       * \brief Навигация по маршруту из байтового буфера
+       * \param route коды направлений (значения direction_t, от 0 до 3)
+       * \param length длина маршрута
+       * \param start_position начальные координаты маршрута
+       * \return конечная точка маршрута
+       * \throw route_error_t если в буфере есть код больше 3,
+       *                      при этом текущее положение не меняется
+       */
+      position_t const & navigate(std::uint8_t const * route, std::size_t length,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /*!
+       * \brief Навигация с записью пройденного пути
+       * \param first, last границы массива направлений
+       * \param trace пройденный путь (содержимое заменяется, память
+       *              переиспользуется между вызовами)
+       * \param start_position начальные координаты маршрута
+       * \return конечная точка маршрута
+       *
+       * Путь записывается участками из одинаковых шагов, шаги в стену
+       * в участки не входят и только подсчитываются. Новая запись
+       * появляется лишь при смене направления, поэтому накладные расходы
+       * по сравнению с navigate(direction_t const *, ...) невелики.
+       */
+      position_t const & navigate(direction_t const * first, direction_t const * last,
+                                  route_trace_t & trace,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /*!
+       * \brief Навигация по маршруту из участков (сжатому длинами серий)
+       * \param first, last границы массива участков
+       * \param start_position начальные координаты маршрута
+       * \return конечная точка маршрута
+       * \throw route_error_t если направление участка некорректно,
+       *                      при этом текущее положение не меняется
+       *
+       * Результат тот же, что у навигации по развёрнутому маршруту, но
+       * участок проходится за O(log n) независимо от длины: шаги в стену
+       * не меняют положения, поэтому участок заканчивается у конца
+       * коридора. Первый такой вызов после изменения карты строит индекс
+       * коридоров за O(n log n), следующие его переиспользуют.
+       */
+      position_t const & navigate(route_run_t const * first, route_run_t const * last,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /*!
+       * \brief Кратчайший маршрут до секции
+       * \param to конечные координаты
+       * \param route найденный маршрут (содержимое заменяется, пуст если маршрута нет)
+       * \param start_position начальные координаты, по умолчанию - текущее положение
+       * \param algorithm алгоритм поиска
+       * \return false если одной из секций нет или to недостижима
+       * \throw position_error_t если начальные координаты не заданы
+       *                         и текущее положение также не задано
+       *
+       * Текущее положение не меняется. Буферы поиска хранятся в лабиринте
+       * и переиспользуются между вызовами (см. path_finder_t)
+       */
+      bool find_route(position_t const & to, std::vector<direction_t> & route,
+                      boost::optional<position_t> const & start_position = boost::none,
+                      search_algorithm_t algorithm = search_astar);
+
+      /*!
+       * \brief Связаны ли секции цепочкой соседних секций
+       * \param from, to координаты секций
+       * \return false если одной из секций нет
+       *
+       * Первый вызов строит индекс компонент связности за O(n), после чего
+       * add_sections обновляет его на месте. Компоненты, из которых
+       * remove_sections удалил секции, пересобираются при следующем запросе
+       * к ним, остальные запросы выполняются почти за O(1).
+       */
+      bool is_reachable(position_t const & from, position_t const & to);
+
+      /*!
+       * \brief Пакетная навигация по независимым маршрутам
+       * \param queries начальные координаты и маршруты
+       * \param results конечные точки маршрутов в порядке запросов,
+       *                boost::none если секции с начальными координатами нет
+       * \param num_threads число потоков, 0 - по числу ядер
+       *
+       * Метод не меняет текущее положение и не использует общего
+       * изменяемого состояния, поэтому его можно вызывать одновременно
+       * из нескольких потоков, пока лабиринт не меняется. Запросы
+       * распределяются по общему пулу потоков с перехватом работы.
+       */
+      void navigate_batch(std::vector<route_query_t> const & queries,
+                          std::vector<boost::optional<position_t>> & results,
+                          unsigned num_threads = 0) const;
+
    private:
       struct impl_t;
       std::unique_ptr<impl_t> pimpl_;
    };
+
+   /*!
+    * \brief Сжимает маршрут в участки из одинаковых направлений
+    * \param first, last границы массива направлений
+    */
+   KNOSSOS_EXPORT std::vector<route_run_t> encode_runs(direction_t const * first,
+                                                       direction_t const * last);
 }
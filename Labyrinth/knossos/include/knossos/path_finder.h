@@ -0,0 +1,56 @@
+/*!
+\file
+\brief Поиск кратчайших маршрутов между секциями
+*/
+
+#pragma once
+
+#include <knossos/snapshot.h>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Поиск кратчайших маршрутов с переиспользуемыми буферами
+    *
+    * Соседи находятся по связям хранилища, как при навигации.
+    * Посещённые секции, очередь и куча поиска хранятся в объекте
+    * и очищаются без освобождения памяти, так что повторные запросы
+    * не выделяют память, пока не потребуется больше прежнего.
+    * Каждый поток заводит свой объект поиска.
+    */
+   class KNOSSOS_EXPORT path_finder_t
+   {
+   public:
+      path_finder_t();
+      ~path_finder_t();
+
+      /*!
+       * \brief Кратчайший маршрут между секциями
+       * \param map снимок карты
+       * \param from, to начальные и конечные координаты
+       * \param route найденный маршрут (содержимое заменяется, пуст если маршрута нет)
+       * \param algorithm алгоритм поиска
+       * \return false если одной из секций нет или to недостижима из from
+       */
+      bool find_route(snapshot_t const & map,
+                      position_t const & from, position_t const & to,
+                      std::vector<direction_t> & route,
+                      search_algorithm_t algorithm = search_astar);
+
+      /// Сколько секций просмотрел последний поиск
+      std::size_t visited() const;
+
+   private:
+      friend class labyrinth_t;
+
+      bool find_route(storage_t const & storage,
+                      position_t const & from, position_t const & to,
+                      std::vector<direction_t> & route,
+                      search_algorithm_t algorithm);
+
+   private:
+      struct impl_t;
+      std::unique_ptr<impl_t> pimpl_;
+   };
+}
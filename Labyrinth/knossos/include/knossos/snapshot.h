@@ -0,0 +1,134 @@
+/*!
+\file
+\brief Неизменяемые снимки карты лабиринта и курсоры для навигации по ним
+*/
+
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+
+namespace knossos
+{
+   struct storage_t;
+
+   /*!
+    * \brief Неизменяемый снимок карты лабиринта
+    *
+    * Снимок получается методом labyrinth_t::snapshot() и разделяет память
+    * с лабиринтом: секции не копируются, пока лабиринт не начнут менять.
+    * Копирование снимка дешёвое. Снимок можно одновременно читать из
+    * любого числа потоков без блокировок. Снимок держит свою версию
+    * карты, пока существует он сам или его копии.
+    */
+   class KNOSSOS_EXPORT snapshot_t
+   {
+   public:
+      /// Пустая карта
+      snapshot_t();
+
+      /// Номер версии лабиринта, с которой сделан снимок
+      std::uint64_t version() const;
+
+      /// Количество секций
+      std::size_t size() const;
+
+      /// Возвращает координаты секций
+      positions_range_t sections() const;
+
+      /// \see labyrinth_t::sections_in
+      void sections_in(region_t const & region, std::vector<position_t> & out) const;
+
+      /// \see labyrinth_t::count_in
+      std::uint64_t count_in(region_t const & region) const;
+
+      /// \see labyrinth_t::sections_within
+      void sections_within(position_t const & center, std::uint32_t radius,
+                           std::vector<position_t> & out) const;
+
+      /// \see labyrinth_t::count_within
+      std::uint64_t count_within(position_t const & center, std::uint32_t radius) const;
+
+      /// Есть ли секция с заданными координатами
+      bool contains(position_t const & position) const;
+
+      /*!
+       * \brief Пакетная навигация по независимым маршрутам
+       * \see labyrinth_t::navigate_batch
+       */
+      void navigate_batch(std::vector<route_query_t> const & queries,
+                          std::vector<boost::optional<position_t>> & results,
+                          unsigned num_threads = 0) const;
+
+   private:
+      friend class labyrinth_t;
+      friend class cursor_t;
+      friend class compiled_route_t;
+      friend class bitboard_t;
+      friend class path_finder_t;
+      friend class agents_t;
+
+      snapshot_t(std::shared_ptr<storage_t const> storage, std::uint64_t version);
+
+      std::shared_ptr<storage_t const> storage_;
+      std::uint64_t                    version_;
+   };
+
+   /*!
+    * \brief Текущее положение на снимке карты
+    *
+    * Лёгкий объект: ссылка на снимок и одна позиция. Каждый поток заводит
+    * свои курсоры, а сам снимок остаётся общим.
+    */
+   class KNOSSOS_EXPORT cursor_t
+   {
+   public:
+      /*!
+       * \brief Курсор на снимке
+       * \param map снимок карты
+       * \param start_position начальное положение
+       * \throw position_error_t если секции с координатами
+       *                         start_position на карте нет
+       */
+      explicit cursor_t(snapshot_t const & map,
+                        boost::optional<position_t> const & start_position = boost::none);
+
+      /// Снимок, по которому перемещается курсор
+      snapshot_t const & map() const;
+
+      /// \see labyrinth_t::is_position_set
+      bool is_position_set() const;
+
+      /// \see labyrinth_t::set_position
+      bool set_position(position_t const & position);
+
+      /// \see labyrinth_t::position
+      position_t const & position() const;
+
+      /// \see labyrinth_t::navigate
+      position_t const & navigate(directions_range_t route,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /// \see labyrinth_t::navigate
+      position_t const & navigate(direction_t const * first, direction_t const * last,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /// \see labyrinth_t::navigate
+      position_t const & navigate(std::uint8_t const * route, std::size_t length,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /// \see labyrinth_t::navigate
+      position_t const & navigate(direction_t const * first, direction_t const * last,
+                                  route_trace_t & trace,
+         boost::optional<position_t> const & start_position = boost::none);
+
+      /// \see labyrinth_t::navigate
+      position_t const & navigate(route_run_t const * first, route_run_t const * last,
+         boost::optional<position_t> const & start_position = boost::none);
+
+   private:
+      snapshot_t                     map_;
+      boost::optional<std::uint64_t> current_;
+      position_t                     current_pos_;
+   };
+}
@@ -0,0 +1,61 @@
+/*!
+\file
+\brief Счётчики и время этапов работы библиотеки Knossos
+*/
+
+#pragma once
+
+#include <knossos/export.h>
+
+#include <cstdint>
+
+
+namespace knossos
+{
+   /// Этап работы, время которого учитывается отдельно
+   enum phase_t
+   {
+      phase_build,      ///< добавление секций (add_sections, reserve), вместе со связыванием
+      phase_remove,     ///< удаление секций
+      phase_optimize,   ///< optimize()
+      phase_index,      ///< построение индексов коридоров и компонент связности
+      phase_navigate,   ///< проход маршрутов
+      phase_save,       ///< запись файла состояния
+      phase_load,       ///< чтение файла состояния
+
+      phase_num
+   };
+
+   /// Название этапа: "build", "remove", ...
+   KNOSSOS_EXPORT char const * phase_name(phase_t phase);
+
+   /*!
+    * \brief Накопленная статистика
+    *
+    * Счётчики общие для всех лабиринтов, снимков и курсоров процесса и
+    * ведутся только в сборке с опцией WITH_STATS (определён KNOSSOS_STATS).
+    * Без неё код учёта не компилируется вовсе, а stats() возвращает нули
+    * с enabled == false.
+    *
+    * Шаги и их время учитываются для navigate лабиринта, курсора и
+    * navigate_batch (время - сумма по потокам), поиск секции - при задании
+    * положения, начала маршрута и в contains().
+    */
+   struct stats_t
+   {
+      bool          enabled            = false;
+      std::uint64_t sections_inserted  = 0;
+      std::uint64_t duplicates_skipped = 0;   ///< уже существовавшие секции
+      std::uint64_t sections_removed   = 0;
+      std::uint64_t lookups            = 0;   ///< поиски секции по координатам
+      std::uint64_t steps_taken        = 0;   ///< шаги, сдвинувшие положение
+      std::uint64_t steps_blocked      = 0;   ///< шаги в стену
+      double        seconds[phase_num] = {};  ///< время этапов
+   };
+
+   /// Текущие значения счётчиков
+   KNOSSOS_EXPORT stats_t stats();
+
+   /// Обнуляет счётчики
+   KNOSSOS_EXPORT void reset_stats();
+}
@@ -0,0 +1,272 @@
+#include <knossos/agents.h>
+
+#include "section_index.h"
+#include "exceptions.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __AVX2__
+#  include <immintrin.h>
+#endif
+
+namespace knossos
+{
+   namespace
+   {
+      /// Байты после последнего маршрута: gather читает код словом в 4 байта
+      /// и у закончившего маршрут агента - с позиции конца, так что слово
+      /// с этой позиции должно целиком помещаться в массив
+      std::size_t const codes_padding = 4;
+
+      /// Агентов в одной порции для потока
+      std::size_t const min_grain_agents = 4096;
+
+      /// Агентов, которые вместе проходят все такты
+      std::size_t const group_agents = 64;
+
+      /// Смещения в маршрутах и в таблице соседей - знаковые 32-битные
+      /// индексы gather
+      std::size_t const max_offset = std::numeric_limits<std::int32_t>::max();
+
+      /*!
+       * Такты агентов [begin, end): section - номера секций, cursor и
+       * finish - положение в общем массиве кодов маршрутов и его конец
+       */
+      struct kernel_t
+      {
+         section_id_t const * next;
+         std::uint8_t const * codes;
+         section_id_t *       section;
+         std::uint32_t *      cursor;
+         std::uint32_t const * finish;
+
+         void step(std::size_t i) const
+         {
+            auto const active = cursor[i] != finish[i];
+            auto const dir = codes[cursor[i]];
+            section[i] = active ? next[std::size_t(section[i]) * total_num + dir] : section[i];
+            cursor[i] += active;
+         }
+
+         /// Шаг агента, маршрут которого точно не закончился
+         void step_active(std::size_t i) const
+         {
+            section[i] = next[std::size_t(section[i]) * total_num + codes[cursor[i]++]];
+         }
+
+#ifdef __AVX2__
+         /// Восемь агентов начиная с i
+         void step8(std::size_t i) const
+         {
+            auto const cur = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cursor + i));
+            auto const fin = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(finish + i));
+            auto const sec = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(section + i));
+
+            // Положение не превышает конца, так что активны все, кроме равных
+            auto const active = _mm256_xor_si256(_mm256_cmpeq_epi32(cur, fin),
+                                                 _mm256_set1_epi32(-1));
+            auto const code = _mm256_and_si256(
+               _mm256_i32gather_epi32(reinterpret_cast<int const *>(codes), cur, 1),
+               _mm256_set1_epi32(0xff));
+            auto const index = _mm256_add_epi32(_mm256_slli_epi32(sec, 2), code);
+            auto const moved = _mm256_mask_i32gather_epi32(
+               sec, reinterpret_cast<int const *>(next), index, active, 4);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(section + i), moved);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(cursor + i),
+                                _mm256_sub_epi32(cur, active));
+         }
+
+         void step8_active(std::size_t i) const
+         {
+            auto const cur = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cursor + i));
+            auto const sec = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(section + i));
+            auto const code = _mm256_and_si256(
+               _mm256_i32gather_epi32(reinterpret_cast<int const *>(codes), cur, 1),
+               _mm256_set1_epi32(0xff));
+            auto const index = _mm256_add_epi32(_mm256_slli_epi32(sec, 2), code);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(section + i),
+                                _mm256_i32gather_epi32(reinterpret_cast<int const *>(next), index, 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(cursor + i),
+                                _mm256_add_epi32(cur, _mm256_set1_epi32(1)));
+         }
+#endif
+
+         void run(std::size_t begin, std::size_t end, std::uint64_t ticks, bool wide) const
+         {
+            // Пока маршруты не кончаются ни у кого из группы, проверки не нужны
+            std::uint64_t shortest = ticks, longest = 0;
+            for (auto i = begin; i != end; ++i)
+            {
+               shortest = std::min<std::uint64_t>(shortest, finish[i] - cursor[i]);
+               longest  = std::max<std::uint64_t>(longest, finish[i] - cursor[i]);
+            }
+
+            for (std::uint64_t tick = 0; tick != shortest; ++tick)
+            {
+               auto i = begin;
+#ifdef __AVX2__
+               if (wide)
+                  for (; i + 8 <= end; i += 8)
+                     step8_active(i);
+#endif
+               for (; i != end; ++i)
+                  step_active(i);
+            }
+
+            for (auto tick = shortest; tick < std::min(ticks, longest); ++tick)
+            {
+               auto i = begin;
+#ifdef __AVX2__
+               if (wide)
+                  for (; i + 8 <= end; i += 8)
+                     step8(i);
+#else
+               (void)wide;
+#endif
+               for (; i != end; ++i)
+                  step(i);
+            }
+         }
+      };
+   }
+
+   struct agents_t::impl_t
+   {
+      impl_t(snapshot_t const & map, unsigned num_threads)
+         : map(map)
+         , index(*map.storage_)
+         , num_threads(num_threads)
+      {
+         auto const count = index.positions.size();
+         if (count > std::numeric_limits<section_id_t>::max() / total_num)
+            throw std::length_error("labyrinth is too large for the agents engine");
+
+         next.resize(count * total_num);
+         parallel_for_stealing(count, num_threads, min_grain_agents,
+            [this](std::size_t begin, std::size_t end)
+            {
+               for (auto id = begin; id != end; ++id)
+                  for (unsigned dir = 0; dir != total_num; ++dir)
+                  {
+                     auto const neighbour = index.id(move(index.positions[id], direction_t(dir)));
+                     next[id * total_num + dir] = neighbour ? *neighbour : section_id_t(id);
+                  }
+            });
+
+         // Индекс gather в таблице соседей - номер секции, умноженный на 4
+         wide = next.size() <= max_offset;
+         codes.resize(codes_padding);
+      }
+
+      snapshot_t const      map;
+      section_index_t const index;
+      unsigned const        num_threads;
+      bool                  wide;
+
+      std::vector<section_id_t> next;   ///< соседи секции id: next[id * 4 + dir]
+      std::vector<std::uint8_t> codes;  ///< маршруты всех агентов подряд
+
+      std::vector<section_id_t>  section;
+      std::vector<std::uint32_t> cursor;
+      std::vector<std::uint32_t> finish;
+
+      std::size_t active = 0;
+   };
+
+   ////////////////////////////////////////////////////////////////////////////
+
+   agents_t::agents_t(snapshot_t const & map, unsigned num_threads)
+      : pimpl_(new impl_t(map, num_threads))
+   {}
+
+   agents_t::~agents_t()
+   {}
+
+   std::size_t agents_t::add(position_t const & start,
+                             direction_t const * first, direction_t const * last)
+   {
+      auto & impl = *pimpl_;
+      auto const id = impl.index.id(start);
+      if (!id)
+         throw incorrect_position_error_t();
+
+      for (auto it = first; it != last; ++it)
+         if (unsigned(*it) >= total_num)
+            throw invalid_direction_error_t();
+
+      auto const used = impl.codes.size() - codes_padding;
+      auto const length = std::size_t(last - first);
+      if (length > max_offset - used)
+         throw std::length_error("routes of the agents are too long");
+
+      impl.codes.resize(used);
+      impl.codes.insert(impl.codes.end(), first, last);
+      impl.codes.resize(used + length + codes_padding);
+
+      impl.section.push_back(*id);
+      impl.cursor.push_back(std::uint32_t(used));
+      impl.finish.push_back(std::uint32_t(used + length));
+      impl.active += length != 0;
+      return impl.section.size() - 1;
+   }
+
+   std::size_t agents_t::size() const
+   {
+      return pimpl_->section.size();
+   }
+
+   std::size_t agents_t::active() const
+   {
+      return pimpl_->active;
+   }
+
+   std::size_t agents_t::advance(std::uint64_t ticks)
+   {
+      auto & impl = *pimpl_;
+      kernel_t const kernel{impl.next.data(), impl.codes.data(), impl.section.data(),
+                            impl.cursor.data(), impl.finish.data()};
+
+      std::atomic<std::size_t> active(0);
+      parallel_for_stealing(impl.section.size(), impl.num_threads, min_grain_agents,
+         [&](std::size_t begin, std::size_t end)
+         {
+            // Небольшая группа проходит все такты подряд: окрестности её
+            // агентов остаются в кеше, а шаги агентов группы независимы
+            for (auto group = begin; group < end; group += group_agents)
+               kernel.run(group, std::min(group + group_agents, end), ticks, impl.wide);
+
+            std::size_t moving = 0;
+            for (auto i = begin; i != end; ++i)
+               moving += impl.cursor[i] != impl.finish[i];
+            active += moving;
+         });
+
+      impl.active = active;
+      return impl.active;
+   }
+
+   position_t agents_t::position(std::size_t agent) const
+   {
+      return pimpl_->index.positions[pimpl_->section.at(agent)];
+   }
+
+   void agents_t::positions(std::vector<position_t> & out) const
+   {
+      auto const & impl = *pimpl_;
+      out.resize(impl.section.size());
+      for (std::size_t i = 0; i != out.size(); ++i)
+         out[i] = impl.index.positions[impl.section[i]];
+   }
+
+   std::uint64_t agents_t::remaining(std::size_t agent) const
+   {
+      return pimpl_->finish.at(agent) - pimpl_->cursor[agent];
+   }
+}
@@ -0,0 +1,334 @@
+#include <knossos/bitboard.h>
+
+#include "storage.h"
+#include "exceptions.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace knossos
+{
+   namespace
+   {
+      typedef std::vector<std::uint64_t> bits_t;
+
+      /*!
+       * Слово битовой карты, сдвинутой на клетку в направлении Dir:
+       * клетка c получает значение клетки c - Dir. source(row, word) -
+       * слово исходной карты, за краем прямоугольника - нули
+       */
+      template <direction_t Dir, class Source>
+      std::uint64_t shifted(Source const & source, std::size_t row, std::size_t word,
+                            std::size_t rows, std::size_t words)
+      {
+         switch (Dir)
+         {
+         case dir_right:
+            return (source(row, word) << 1) | (word != 0 ? source(row, word - 1) >> 63 : 0);
+         case dir_left:
+            return (source(row, word) >> 1) | (word + 1 != words ? source(row, word + 1) << 63 : 0);
+         case dir_up:
+            return row != 0 ? source(row - 1, word) : 0;
+         default:
+            return row + 1 != rows ? source(row + 1, word) : 0;
+         }
+      }
+
+      /// Слов в строке на один поток, меньшие порции не делятся
+      std::size_t const min_grain_words = 2048;
+   }
+
+   struct bitboard_t::impl_t
+   {
+      impl_t(storage_t const & storage, unsigned num_threads)
+         : num_threads(num_threads)
+      {
+         if (storage.size() == 0)
+            return;
+
+         position_t low(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+         position_t high(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+         for (auto const & pos : storage.positions())
+         {
+            low  = position_t(std::min(low.x, pos.x), std::min(low.y, pos.y));
+            high = position_t(std::max(high.x, pos.x), std::max(high.y, pos.y));
+         }
+
+         origin = low;
+         width  = std::size_t(std::int64_t(high.x) - low.x + 1);
+         height = std::size_t(std::int64_t(high.y) - low.y + 1);
+         words  = (width + 63) / 64;
+
+         board.assign(height * words, 0);
+         for (auto const & pos : storage.positions())
+            set(board, pos);
+
+         open_towards<dir_up, dir_down>();
+         open_towards<dir_down, dir_up>();
+         open_towards<dir_left, dir_right>();
+         open_towards<dir_right, dir_left>();
+      }
+
+      bool contains(position_t const & pos) const
+      {
+         auto const x = std::int64_t(pos.x) - origin.x;
+         auto const y = std::int64_t(pos.y) - origin.y;
+         return x >= 0 && std::uint64_t(x) < width && y >= 0 && std::uint64_t(y) < height;
+      }
+
+      void set(bits_t & bits, position_t const & pos) const
+      {
+         auto const x = std::size_t(pos.x - origin.x);
+         auto const y = std::size_t(pos.y - origin.y);
+         bits[y * words + x / 64] |= std::uint64_t(1) << (x % 64);
+      }
+
+      /// Секции из positions, остальные координаты пропускаются
+      bits_t make_bits(std::vector<position_t> const & positions) const
+      {
+         bits_t bits(board.size());
+         for (auto const & pos : positions)
+            if (contains(pos))
+               set(bits, pos);
+         for (std::size_t i = 0; i != bits.size(); ++i)
+            bits[i] &= board[i];
+         return bits;
+      }
+
+      std::vector<position_t> list(bits_t const & bits) const
+      {
+         std::vector<position_t> positions;
+         for (std::size_t row = 0; row != height; ++row)
+            for (std::size_t word = 0; word != words; ++word)
+               for (auto w = bits[row * words + word]; w; w &= w - 1)
+                  positions.emplace_back(origin.x + int(word * 64 + count_trailing_zeros(w)),
+                                         origin.y + int(row));
+         return positions;
+      }
+
+      /// body(first_row, last_row) для непересекающихся полос строк
+      template <class Body>
+      void for_rows(Body const & body) const
+      {
+         auto const grain = std::max<std::size_t>(1, min_grain_words / std::max<std::size_t>(1, words));
+         parallel_for_stealing(height, num_threads, grain, body);
+      }
+
+      /// Клетки, соседняя с которыми в направлении Dir - тоже секция
+      template <direction_t Dir, direction_t Back>
+      void open_towards()
+      {
+         auto source = [this](std::size_t row, std::size_t word)
+         {
+            return board[row * words + word];
+         };
+
+         auto & bits = open[Dir];
+         bits.resize(board.size());
+         for (std::size_t row = 0; row != height; ++row)
+            for (std::size_t word = 0; word != words; ++word)
+               bits[row * words + word] = board[row * words + word]
+                  & shifted<Back>(source, row, word, height, words);
+      }
+
+      /// Шагающие, перед которыми есть секция, сдвигаются, остальные стоят
+      template <direction_t Dir>
+      void forward(bits_t const & from, bits_t & to) const
+      {
+         auto const & moves = open[Dir];
+         auto moving = [&](std::size_t row, std::size_t word)
+         {
+            return from[row * words + word] & moves[row * words + word];
+         };
+
+         for_rows([&](std::size_t first, std::size_t last)
+         {
+            for (auto row = first; row != last; ++row)
+               for (std::size_t word = 0; word != words; ++word)
+               {
+                  auto const i = row * words + word;
+                  to[i] = shifted<Dir>(moving, row, word, height, words) | (from[i] & ~moves[i]);
+               }
+         });
+      }
+
+      /// Клетки, шаг из которых в направлении Dir попадает в from
+      template <direction_t Dir, direction_t Back>
+      void backward(bits_t const & from, bits_t & to) const
+      {
+         auto const & moves = open[Dir];
+         auto source = [&](std::size_t row, std::size_t word)
+         {
+            return from[row * words + word];
+         };
+
+         for_rows([&](std::size_t first, std::size_t last)
+         {
+            for (auto row = first; row != last; ++row)
+               for (std::size_t word = 0; word != words; ++word)
+               {
+                  auto const i = row * words + word;
+                  to[i] = (moves[i] & shifted<Back>(source, row, word, height, words))
+                     | (from[i] & ~moves[i]);
+               }
+         });
+      }
+
+      void forward(bits_t & bits, direction_t const * first, direction_t const * last) const
+      {
+         bits_t next(bits.size());
+         for (; first != last; ++first)
+         {
+            switch (*first)
+            {
+            case dir_up:    forward<dir_up>(bits, next);    break;
+            case dir_down:  forward<dir_down>(bits, next);  break;
+            case dir_left:  forward<dir_left>(bits, next);  break;
+            case dir_right: forward<dir_right>(bits, next); break;
+            default:        throw invalid_direction_error_t();
+            }
+            bits.swap(next);
+         }
+      }
+
+      void backward(bits_t & bits, direction_t const * first, direction_t const * last) const
+      {
+         bits_t next(bits.size());
+         while (first != last)
+         {
+            switch (*--last)
+            {
+            case dir_up:    backward<dir_up, dir_down>(bits, next);    break;
+            case dir_down:  backward<dir_down, dir_up>(bits, next);    break;
+            case dir_left:  backward<dir_left, dir_right>(bits, next); break;
+            case dir_right: backward<dir_right, dir_left>(bits, next); break;
+            default:        throw invalid_direction_error_t();
+            }
+            bits.swap(next);
+         }
+      }
+
+      unsigned const num_threads;
+
+      position_t  origin;
+      std::size_t width  = 0;
+      std::size_t height = 0;
+      std::size_t words  = 0;  ///< слов в строке
+
+      bits_t board;
+      bits_t open[total_num];
+   };
+
+   ////////////////////////////////////////////////////////////////////////////
+
+   bitboard_t::bitboard_t(snapshot_t const & map, unsigned num_threads)
+      : pimpl_(new impl_t(*map.storage_, num_threads))
+   {}
+
+   bitboard_t::~bitboard_t()
+   {}
+
+   position_t bitboard_t::origin() const
+   {
+      return pimpl_->origin;
+   }
+
+   std::size_t bitboard_t::width() const
+   {
+      return pimpl_->width;
+   }
+
+   std::size_t bitboard_t::height() const
+   {
+      return pimpl_->height;
+   }
+
+   std::vector<position_t> bitboard_t::occupied(direction_t const * first,
+                                                direction_t const * last) const
+   {
+      auto bits = pimpl_->board;
+      pimpl_->forward(bits, first, last);
+      return pimpl_->list(bits);
+   }
+
+   std::vector<position_t> bitboard_t::occupied(std::vector<position_t> const & starts,
+                                                direction_t const * first,
+                                                direction_t const * last) const
+   {
+      auto bits = pimpl_->make_bits(starts);
+      pimpl_->forward(bits, first, last);
+      return pimpl_->list(bits);
+   }
+
+   std::vector<position_t> bitboard_t::reaching(std::vector<position_t> const & targets,
+                                                direction_t const * first,
+                                                direction_t const * last) const
+   {
+      auto bits = pimpl_->make_bits(targets);
+      pimpl_->backward(bits, first, last);
+      return pimpl_->list(bits);
+   }
+
+   void bitboard_t::mapping(direction_t const * first, direction_t const * last,
+                            std::vector<position_t> & starts, std::vector<position_t> & ends) const
+   {
+      auto const & impl = *pimpl_;
+      auto const cells = impl.width * impl.height;
+      if (cells > std::numeric_limits<std::uint32_t>::max())
+         throw std::length_error("labyrinth is too large for the route mapping");
+
+      // end[c] - конечная клетка оставшейся части маршрута из клетки c,
+      // шаги добавляются к началу: end'(c) = end(шаг(c)). Поля по строке
+      // с каждой стороны позволяют читать соседа без проверки границ
+      auto const pad = impl.width + 1;
+      std::vector<std::uint32_t> end(cells + 2 * pad), next(cells + 2 * pad);
+      for (std::size_t cell = 0; cell != cells; ++cell)
+         end[pad + cell] = std::uint32_t(cell);
+
+      while (first != last)
+      {
+         auto const dir = *--last;
+         if (unsigned(dir) >= total_num)
+            throw invalid_direction_error_t();
+
+         auto const & moves = impl.open[dir];
+         std::ptrdiff_t const delta =
+            dir == dir_right ? 1 :
+            dir == dir_left  ? -1 :
+            dir == dir_up    ? std::ptrdiff_t(impl.width) : -std::ptrdiff_t(impl.width);
+
+         impl.for_rows([&](std::size_t first_row, std::size_t last_row)
+         {
+            for (auto row = first_row; row != last_row; ++row)
+            {
+               auto const * from  = end.data() + pad + row * impl.width;
+               auto const * moved = from + delta;
+               auto * to = next.data() + pad + row * impl.width;
+
+               // Выбор без ветвлений по маске из бита, цикл векторизуется
+               for (std::size_t x = 0; x != impl.width; ++x)
+               {
+                  auto const open = (moves[row * impl.words + x / 64] >> (x % 64)) & 1;
+                  auto const mask = std::uint32_t(0) - std::uint32_t(open);
+                  to[x] = from[x] ^ ((from[x] ^ moved[x]) & mask);
+               }
+            }
+         });
+         end.swap(next);
+      }
+
+      starts = impl.list(impl.board);
+      ends.clear();
+      ends.reserve(starts.size());
+      for (auto const & start : starts)
+      {
+         auto const cell = end[pad + std::size_t(start.y - impl.origin.y) * impl.width
+                                     + std::size_t(start.x - impl.origin.x)];
+         ends.emplace_back(impl.origin.x + int(cell % impl.width),
+                           impl.origin.y + int(cell / impl.width));
+      }
+   }
+}
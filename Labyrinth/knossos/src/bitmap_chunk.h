@@ -0,0 +1,241 @@
+#pragma once
+
+#include "storage.h"
+#include "position_table.h"
+#include "utils.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+
+namespace knossos
+{
+   int const chunk_bits = 6;
+   int const chunk_side = 1 << chunk_bits;
+   int const chunk_mask = chunk_side - 1;
+   int const chunk_area = chunk_side * chunk_side;
+
+   /// Блок chunk_side x chunk_side секций: строка блока - одно слово,
+   /// младший бит слова соответствует младшей координате x
+   struct chunk_t
+   {
+      explicit chunk_t(position_t const & origin)
+         : origin(origin)
+         , rows{{}}
+      {}
+
+      bool test(int lx, int ly) const
+      {
+         return (rows[ly] >> lx) & 1;
+      }
+
+      /// Номер первого установленного бита, начиная с bit, либо chunk_area
+      int next_bit(int bit) const
+      {
+         for (int row = bit >> chunk_bits; bit < chunk_area; row = bit >> chunk_bits)
+         {
+            auto word = rows[row] >> (bit & chunk_mask);
+            if (word)
+               return bit + count_trailing_zeros(word);
+            bit = (row + 1) << chunk_bits;
+         }
+         return chunk_area;
+      }
+
+      /// Номер последнего установленного бита, не превышающего bit, либо -1
+      int prev_bit(int bit) const
+      {
+         for (int row = bit >> chunk_bits; bit >= 0; row = bit >> chunk_bits)
+         {
+            auto word = rows[row] << (chunk_mask - (bit & chunk_mask));
+            if (word)
+               return bit - count_leading_zeros(word);
+            bit = (row << chunk_bits) - 1;
+         }
+         return -1;
+      }
+
+      position_t position(int bit) const
+      {
+         return position_t(origin.x * chunk_side + (bit & chunk_mask),
+                           origin.y * chunk_side + (bit >> chunk_bits));
+      }
+
+      position_t    origin;  ///< координаты блока (а не его первой секции)
+      std::uint32_t count = 0;
+      std::array<std::uint64_t, chunk_side> rows;
+   };
+
+   inline position_t chunk_of(position_t const & pos)
+   {
+      return position_t(pos.x >> chunk_bits, pos.y >> chunk_bits);
+   }
+
+   /// Список блоков, который итератор держит сам, пока обход не закончен
+   typedef std::vector<chunk_t const *> chunk_list_t;
+
+   inline chunk_t const & chunk_at(std::vector<chunk_t> const * chunks, std::size_t index)
+   {
+      return (*chunks)[index];
+   }
+
+   inline std::size_t chunk_count(std::vector<chunk_t> const * chunks)
+   {
+      return chunks->size();
+   }
+
+   inline chunk_t const & chunk_at(std::shared_ptr<chunk_list_t const> const & chunks,
+                                   std::size_t index)
+   {
+      return *(*chunks)[index];
+   }
+
+   inline std::size_t chunk_count(std::shared_ptr<chunk_list_t const> const & chunks)
+   {
+      return chunks->size();
+   }
+
+   /*!
+    * \brief Обход установленных битов по всем блокам
+    *
+    * Chunks - ссылка на последовательность непустых блоков, доступ
+    * к которой идёт через chunk_at/chunk_count
+    */
+   template <class Chunks>
+   class chunk_iterator_t
+      : public boost::iterator_facade<
+            chunk_iterator_t<Chunks>,
+            position_t const,
+            boost::bidirectional_traversal_tag,
+            position_t const>
+   {
+   public:
+      chunk_iterator_t()
+         : chunks_()
+         , chunk_(0)
+         , bit_(0)
+      {}
+
+      chunk_iterator_t(Chunks chunks, std::size_t chunk, int bit)
+         : chunks_(std::move(chunks))
+         , chunk_(chunk)
+         , bit_(bit)
+      {}
+
+      /// Диапазон всех секций
+      static positions_range_t range(Chunks const & chunks)
+      {
+         auto const count = chunk_count(chunks);
+         chunk_iterator_t begin(chunks, 0, count ? chunk_at(chunks, 0).next_bit(0) : 0);
+         chunk_iterator_t end(chunks, count, 0);
+         return boost::make_iterator_range(begin, end);
+      }
+
+   private:
+      friend class boost::iterator_core_access;
+
+      position_t const dereference() const
+      {
+         return chunk_at(chunks_, chunk_).position(bit_);
+      }
+
+      bool equal(chunk_iterator_t const & other) const
+      {
+         return chunk_ == other.chunk_ && bit_ == other.bit_;
+      }
+
+      void increment()
+      {
+         bit_ = chunk_at(chunks_, chunk_).next_bit(bit_ + 1);
+         if (bit_ == chunk_area)
+         {
+            // пустых блоков не бывает
+            ++chunk_;
+            bit_ = chunk_ == chunk_count(chunks_) ? 0 : chunk_at(chunks_, chunk_).next_bit(0);
+         }
+      }
+
+      void decrement()
+      {
+         int bit = chunk_ == chunk_count(chunks_) ? -1 : chunk_at(chunks_, chunk_).prev_bit(bit_ - 1);
+         if (bit < 0)
+         {
+            --chunk_;
+            bit = chunk_at(chunks_, chunk_).prev_bit(chunk_area - 1);
+         }
+         bit_ = bit;
+      }
+
+   private:
+      Chunks      chunks_;
+      std::size_t chunk_;
+      int         bit_;
+   };
+
+   /*!
+    * \brief Общая часть хранилищ из битовых блоков
+    *
+    * Дескриптор - упакованные координаты секции, курсор обхода помнит
+    * свой блок, так что соседний блок ищется только при выходе за его
+    * границу. Derived::find_chunk(origin) возвращает блок по его
+    * координатам или nullptr.
+    */
+   template <class Derived>
+   struct chunked_storage_t : storage_base_t<Derived>
+   {
+      typedef storage_t::handle_t handle_t;
+
+      boost::optional<handle_t> find(position_t const & pos) const override
+      {
+         auto chunk = self().find_chunk(chunk_of(pos));
+         if (!chunk || !chunk->test(pos.x & chunk_mask, pos.y & chunk_mask))
+            return boost::none;
+         return pack_position(pos);
+      }
+
+      position_t position(handle_t handle) const override
+      {
+         return unpack_position(handle);
+      }
+
+      struct cursor_t
+      {
+         chunk_t const * chunk;
+         position_t      pos;
+      };
+
+      cursor_t cursor(handle_t handle) const
+      {
+         auto pos = unpack_position(handle);
+         return cursor_t{self().find_chunk(chunk_of(pos)), pos};
+      }
+
+      static handle_t handle(cursor_t const & cursor)
+      {
+         return pack_position(cursor.pos);
+      }
+
+      void step(cursor_t & cursor, direction_t dir) const
+      {
+         auto next = move(cursor.pos, dir);
+         auto chunk = cursor.chunk;
+
+         // Выход за границу блока: соседний блок ищется заново
+         if (((next.x ^ cursor.pos.x) | (next.y ^ cursor.pos.y)) & ~chunk_mask)
+            if (!(chunk = self().find_chunk(chunk_of(next))))
+               return;
+
+         if (chunk->test(next.x & chunk_mask, next.y & chunk_mask))
+            cursor = cursor_t{chunk, next};
+      }
+
+   private:
+      Derived const & self() const
+      {
+         return static_cast<Derived const &>(*this);
+      }
+   };
+}
@@ -0,0 +1,118 @@
+#include "bitmap_chunk.h"
+
+#include <algorithm>
+
+namespace knossos
+{
+   namespace
+   {
+      /*!
+       * Хранение секций битовыми блоками 64x64, блоки ищутся в хеш-таблице
+       * по координатам блока. Соседи не хранятся, а проверяются по битам,
+       * так что на секцию плотного лабиринта приходится около одного бита.
+       * Дескриптор - упакованные координаты секции.
+       */
+      struct bitmap_storage_t : chunked_storage_t<bitmap_storage_t>
+      {
+         std::unique_ptr<storage_t> clone() const override
+         {
+            return std::unique_ptr<storage_t>(new bitmap_storage_t(*this));
+         }
+
+         bool insert(position_t const & pos) override
+         {
+            auto origin = chunk_of(pos);
+            auto result = directory.insert(origin);
+            if (result.second)
+            {
+               directory.value(result.first) = std::uint32_t(chunks.size());
+               chunks.emplace_back(origin);
+            }
+
+            auto & chunk = chunks[directory.value(result.first)];
+            auto & row = chunk.rows[pos.y & chunk_mask];
+            auto const bit = std::uint64_t(1) << (pos.x & chunk_mask);
+            if (row & bit)
+               return false;
+
+            row |= bit;
+            ++chunk.count;
+            ++total;
+            return true;
+         }
+
+         bool erase(position_t const & pos) override
+         {
+            auto slot = directory.find(chunk_of(pos));
+            if (slot == directory_t::npos)
+               return false;
+
+            auto const index = directory.value(slot);
+            auto & chunk = chunks[index];
+            auto & row = chunk.rows[pos.y & chunk_mask];
+            auto const bit = std::uint64_t(1) << (pos.x & chunk_mask);
+            if (!(row & bit))
+               return false;
+
+            row &= ~bit;
+            --total;
+            if (--chunk.count == 0)
+            {
+               // Пустой блок заменяется последним
+               directory.erase_slot(slot);
+               if (index + 1 != chunks.size())
+               {
+                  chunk = chunks.back();
+                  directory.value(directory.find(chunk.origin)) = index;
+               }
+               chunks.pop_back();
+            }
+            return true;
+         }
+
+         std::size_t size() const override
+         {
+            return total;
+         }
+
+         positions_range_t positions() const override
+         {
+            return chunk_iterator_t<std::vector<chunk_t> const *>::range(&chunks);
+         }
+
+         /// Упорядочивает блоки вдоль кривой Мортона
+         void optimize() override
+         {
+            std::sort(chunks.begin(), chunks.end(),
+               [](chunk_t const & l, chunk_t const & r)
+               {
+                  return morton_code(l.origin) < morton_code(r.origin);
+               });
+
+            for (std::size_t i = 0; i != chunks.size(); ++i)
+               directory.value(directory.find(chunks[i].origin)) = std::uint32_t(i);
+         }
+
+         /// Блок с координатами origin либо nullptr
+         chunk_t const * find_chunk(position_t const & origin) const
+         {
+            auto slot = directory.find(origin);
+            if (slot == directory_t::npos)
+               return nullptr;
+            return &chunks[directory.value(slot)];
+         }
+
+      private:
+         typedef position_table_t<std::uint32_t> directory_t;
+
+         std::vector<chunk_t> chunks;
+         directory_t directory;
+         std::size_t total = 0;
+      };
+   }
+
+   std::unique_ptr<storage_t> make_bitmap_storage()
+   {
+      return std::unique_ptr<storage_t>(new bitmap_storage_t);
+   }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+namespace knossos
+{
+   /// Число частей, на которое стоит делить count элементов между потоками
+   inline unsigned parallel_parts(std::size_t count, unsigned num_threads,
+                                  std::size_t min_part = 1 << 14)
+   {
+      if (num_threads == 0)
+         num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+      auto const parts = std::max<std::size_t>(1, count / min_part);
+      return unsigned(std::min<std::size_t>(num_threads, parts));
+   }
+
+   /// Выполняет task(part) для каждой части, часть 0 - в текущем потоке
+   template <class Task>
+   void parallel_for_parts(unsigned parts, Task const & task)
+   {
+      std::vector<std::thread> threads;
+      for (unsigned part = 1; part < parts; ++part)
+         threads.emplace_back([&task, part] { task(part); });
+
+      task(0);
+      for (auto & thread : threads)
+         thread.join();
+   }
+
+   /// Сортировка частями в нескольких потоках с последующим попарным слиянием
+   template <class T, class Less>
+   void parallel_sort(std::vector<T> & values, Less less, unsigned num_threads)
+   {
+      auto const parts = parallel_parts(values.size(), num_threads);
+
+      std::vector<std::size_t> bounds(parts + 1);
+      for (unsigned part = 0; part <= parts; ++part)
+         bounds[part] = values.size() * part / parts;
+
+      auto const begin = values.begin();
+      parallel_for_parts(parts, [&](unsigned part)
+      {
+         std::sort(begin + bounds[part], begin + bounds[part + 1], less);
+      });
+
+      for (unsigned width = 1; width < parts; width *= 2)
+      {
+         auto const merges = (parts + 2 * width - 1) / (2 * width);
+         parallel_for_parts(merges, [&](unsigned merge)
+         {
+            auto const first = merge * 2 * width;
+            if (first + width >= parts)
+               return;
+
+            auto const last = std::min(first + 2 * width, parts);
+            std::inplace_merge(begin + bounds[first],
+                               begin + bounds[first + width],
+                               begin + bounds[last], less);
+         });
+      }
+   }
+
+   /// Порядок, в котором секции связываются пакетно: по столбцам x, внутри - по y
+   struct column_order_t
+   {
+      bool operator() (position_t const & l, position_t const & r) const
+      {
+         return l.x < r.x || (l.x == r.x && l.y < r.y);
+      }
+   };
+
+   /// Сортирует по column_order_t и удаляет повторы
+   inline void sort_unique(std::vector<position_t> & positions, unsigned num_threads)
+   {
+      parallel_sort(positions, column_order_t(), num_threads);
+      positions.erase(std::unique(positions.begin(), positions.end(),
+                                  [](position_t const & l, position_t const & r)
+                                  {
+                                     return l.x == r.x && l.y == r.y;
+                                  }),
+                      positions.end());
+   }
+
+   namespace bulk_detail
+   {
+      template <class Link>
+      void link_columns(std::vector<position_t> const & sorted,
+                        std::size_t begin, std::size_t end, Link const & link)
+      {
+         auto const size = sorted.size();
+         std::size_t next = begin;
+
+         for (std::size_t i = begin; i != end; ++i)
+         {
+            auto const & pos = sorted[i];
+            if (i + 1 != size && sorted[i + 1].x == pos.x && sorted[i + 1].y == pos.y + 1)
+               link(i, i + 1, dir_up);
+
+            // Начало столбца: ищем начало следующего
+            if (i == begin || sorted[i - 1].x != pos.x)
+               for (next = i; next != size && sorted[next].x == pos.x; ++next)
+                  ;
+
+            while (next != size && sorted[next].x == pos.x + 1 && sorted[next].y < pos.y)
+               ++next;
+            if (next != size && sorted[next].x == pos.x + 1 && sorted[next].y == pos.y)
+               link(i, next, dir_right);
+         }
+      }
+   }
+
+   /*!
+    * \brief Находит всех соседей в отсортированном по column_order_t
+    *        массиве уникальных координат за линейное время
+    *
+    * Для каждой пары соседей вызывается link(i, j, dir), где j - номер
+    * секции, соседней с i в направлении dir (dir_up или dir_right).
+    * Массив делится на части по границам столбцов, каждая часть
+    * обрабатывается своим потоком; разные потоки вызывают link для
+    * разных пар, но одна секция может попасть в вызовы из двух потоков.
+    */
+   template <class Link>
+   void link_sorted(std::vector<position_t> const & sorted, unsigned num_threads,
+                    Link const & link)
+   {
+      auto const size  = sorted.size();
+      auto const parts = parallel_parts(size, num_threads);
+
+      std::vector<std::size_t> bounds(parts + 1);
+      for (unsigned part = 0; part <= parts; ++part)
+      {
+         auto bound = size * part / parts;
+         while (bound != 0 && bound != size && sorted[bound - 1].x == sorted[bound].x)
+            ++bound;
+         bounds[part] = std::max(bound, part ? bounds[part - 1] : 0);
+      }
+
+      parallel_for_parts(parts, [&](unsigned part)
+      {
+         bulk_detail::link_columns(sorted, bounds[part], bounds[part + 1], link);
+      });
+   }
+}
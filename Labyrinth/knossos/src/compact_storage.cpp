@@ -0,0 +1,341 @@
+#include "storage.h"
+#include "bulk.h"
+#include "position_table.h"
+#include "state_file.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+
+#include <boost/range/adaptor/filtered.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/counting_range.hpp>
+
+namespace ba = boost::adaptors;
+using boost::optional;
+
+namespace knossos
+{
+   namespace
+   {
+      /// Секция в непрерывном массиве: соседи задаются номерами,
+      /// отсутствующий сосед - номер самой секции
+      struct node_t
+      {
+         position_t pos;
+         std::array<std::uint32_t, direction_t::total_num> neigbours;
+      };
+
+      struct node_alive_t
+      {
+         std::vector<bool> const * alive;
+
+         bool operator() (std::size_t index) const
+         {
+            return (*alive)[index];
+         }
+      };
+
+      struct node_position_t
+      {
+         std::vector<node_t> const * nodes;
+
+         position_t operator() (std::size_t index) const
+         {
+            return (*nodes)[index].pos;
+         }
+      };
+
+      /*!
+       * Секции лежат в одном векторе, соседи - 32-битные номера в нём,
+       * поэтому шаг маршрута - одно чтение из массива без ветвлений.
+       * Координаты ищутся через хеш-таблицу номеров.
+       * Удалённые секции остаются "надгробиями" до очередного уплотнения,
+       * которое происходит, когда их становится больше, чем живых.
+       */
+      struct compact_storage_t : storage_base_t<compact_storage_t>
+      {
+         typedef std::uint32_t index_t;
+
+         std::unique_ptr<storage_t> clone() const override
+         {
+            return std::unique_ptr<storage_t>(new compact_storage_t(*this));
+         }
+
+         bool insert(position_t const & pos) override
+         {
+            auto result = index.insert(pos);
+            if (!result.second)
+               return false;
+
+            auto const self = index_t(nodes.size());
+            index.value(result.first) = self;
+
+            node_t node{pos, {{self, self, self, self}}};
+            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
+            {
+               auto slot = index.find(move(pos, dir));
+               if (slot != table_t::npos)
+               {
+                  auto neigbour = index.value(slot);
+                  node.neigbours[dir] = neigbour;
+                  nodes[neigbour].neigbours[opposite_direction(dir)] = self;
+               }
+            }
+            nodes.push_back(node);
+            alive.push_back(true);
+            return true;
+         }
+
+         void insert_bulk(std::vector<position_t> & sorted, unsigned num_threads) override
+         {
+            sort_unique(sorted, num_threads);
+            if (!nodes.empty())
+               return merge_bulk(sorted, num_threads);
+
+            nodes.resize(sorted.size());
+            alive.assign(sorted.size(), true);
+            index.reserve(sorted.size());
+
+            for (std::size_t i = 0; i != sorted.size(); ++i)
+            {
+               auto const self = index_t(i);
+               nodes[i] = node_t{sorted[i], {{self, self, self, self}}};
+               index.value(index.insert(sorted[i]).first) = self;
+            }
+
+            link_sorted(sorted, num_threads,
+               [this](std::size_t from, std::size_t to, direction_t dir)
+               {
+                  nodes[from].neigbours[dir] = index_t(to);
+                  nodes[to].neigbours[opposite_direction(dir)] = index_t(from);
+               });
+         }
+
+         void reserve(std::size_t count) override
+         {
+            nodes.reserve(count);
+            alive.reserve(count);
+            index.reserve(count);
+         }
+
+         bool erase(position_t const & pos) override
+         {
+            auto slot = index.find(pos);
+            if (slot == table_t::npos)
+               return false;
+
+            auto const self = index.value(slot);
+            index.erase_slot(slot);
+
+            auto & node = nodes[self];
+            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
+            {
+               auto neigbour = node.neigbours[dir];
+               if (neigbour != self)
+               {
+                  nodes[neigbour].neigbours[opposite_direction(dir)] = neigbour;
+                  node.neigbours[dir] = self;
+               }
+            }
+            alive[self] = false;
+
+            if (++dead > index.size() && dead >= min_compaction)
+               compact();
+            return true;
+         }
+
+         std::size_t size() const override
+         {
+            return index.size();
+         }
+
+         positions_range_t positions() const override
+         {
+            return boost::counting_range(std::size_t(0), nodes.size())
+               | ba::filtered(node_alive_t{&alive})
+               | ba::transformed(node_position_t{&nodes});
+         }
+
+         optional<handle_t> find(position_t const & pos) const override
+         {
+            auto slot = index.find(pos);
+            if (slot == table_t::npos)
+               return boost::none;
+            return handle_t(index.value(slot));
+         }
+
+         position_t position(handle_t handle) const override
+         {
+            return nodes[std::size_t(handle)].pos;
+         }
+
+         /// Номера соседей не зависят от адресов, массив пишется как есть
+         void save(state_writer_t & out) const override
+         {
+            out.array(nodes);
+            out.array(std::vector<std::uint8_t>(alive.begin(), alive.end()));
+            out.value(std::uint64_t(dead));
+            index.save(out);
+         }
+
+         void load(state_reader_t & in) override
+         {
+            std::vector<std::uint8_t> flags;
+            std::uint64_t dead_count;
+            in.array(nodes);
+            in.array(flags);
+            in.value(dead_count);
+            if (!index.load(in) || flags.size() != nodes.size()
+                || dead_count > nodes.size() || index.size() != nodes.size() - dead_count)
+               throw state_corrupt_error_t();
+
+            // Контрольная сумма ловит только случайные повреждения, а номер
+            // за пределами массива привёл бы к чтению мимо него при обходе.
+            // Отсутствующий сосед - номер самой секции, он тоже в пределах
+            for (auto const & node : nodes)
+               for (auto neigbour : node.neigbours)
+                  if (neigbour >= nodes.size())
+                     throw state_corrupt_error_t();
+            for (std::size_t slot = 0; slot != index.capacity(); ++slot)
+               if (index.occupied(slot) && index.value(slot) >= nodes.size())
+                  throw state_corrupt_error_t();
+
+            alive.assign(flags.begin(), flags.end());
+            dead = std::size_t(dead_count);
+         }
+
+         typedef index_t cursor_t;
+
+         static cursor_t cursor(handle_t handle)
+         {
+            return cursor_t(handle);
+         }
+
+         static handle_t handle(cursor_t cursor)
+         {
+            return cursor;
+         }
+
+         void step(cursor_t & cursor, direction_t dir) const
+         {
+            cursor = nodes[cursor].neigbours[dir];
+         }
+
+         /// Раскладывает секции вдоль кривой Мортона, чтобы соседи
+         /// на плоскости в основном оказывались рядом и в памяти
+         void optimize() override
+         {
+            std::vector<std::pair<std::uint64_t, index_t>> keys;
+            keys.reserve(index.size());
+            for (std::size_t i = 0; i != nodes.size(); ++i)
+               if (alive[i])
+                  keys.emplace_back(morton_code(nodes[i].pos), index_t(i));
+            std::sort(keys.begin(), keys.end());
+
+            std::vector<index_t> order;
+            order.reserve(keys.size());
+            for (auto const & key : keys)
+               order.push_back(key.second);
+            reorder(order);
+         }
+
+      private:
+         typedef position_table_t<index_t> table_t;
+
+         /*!
+          * Пакет в непустое хранилище: секции пакета связываются между
+          * собой линейными проходами, а соседи среди прежних секций
+          * ищутся только в тех направлениях, где пакет их не дал
+          */
+         void merge_bulk(std::vector<position_t> const & sorted, unsigned num_threads)
+         {
+            auto const first = nodes.size();
+            std::vector<index_t> ids(sorted.size());
+            index.reserve(index.size() + sorted.size());
+
+            for (std::size_t i = 0; i != sorted.size(); ++i)
+            {
+               auto const result = index.insert(sorted[i]);
+               if (result.second)
+               {
+                  auto const self = index_t(nodes.size());
+                  index.value(result.first) = self;
+                  nodes.push_back(node_t{sorted[i], {{self, self, self, self}}});
+                  alive.push_back(true);
+               }
+               ids[i] = index.value(result.first);
+            }
+
+            link_sorted(sorted, num_threads,
+               [this, &ids](std::size_t from, std::size_t to, direction_t dir)
+               {
+                  nodes[ids[from]].neigbours[dir] = ids[to];
+                  nodes[ids[to]].neigbours[opposite_direction(dir)] = ids[from];
+               });
+
+            for (auto self = index_t(first); self != nodes.size(); ++self)
+               for (auto dir : {dir_left, dir_right, dir_down, dir_up})
+               {
+                  if (nodes[self].neigbours[dir] != self)
+                     continue;
+
+                  auto slot = index.find(move(nodes[self].pos, dir));
+                  if (slot != table_t::npos)
+                  {
+                     auto neigbour = index.value(slot);
+                     nodes[self].neigbours[dir] = neigbour;
+                     nodes[neigbour].neigbours[opposite_direction(dir)] = self;
+                  }
+               }
+         }
+
+         /// Удаляет надгробия, сохраняя взаимный порядок живых секций
+         void compact()
+         {
+            std::vector<index_t> order;
+            order.reserve(index.size());
+            for (std::size_t i = 0; i != nodes.size(); ++i)
+               if (alive[i])
+                  order.push_back(index_t(i));
+            reorder(order);
+         }
+
+         /// Оставляет только секции order (старые номера) в указанном порядке
+         void reorder(std::vector<index_t> const & order)
+         {
+            std::vector<index_t> remap(nodes.size());
+            for (std::size_t i = 0; i != order.size(); ++i)
+               remap[order[i]] = index_t(i);
+
+            std::vector<node_t> ordered;
+            ordered.reserve(order.size());
+            for (auto old : order)
+            {
+               auto node = nodes[old];
+               for (auto & neigbour : node.neigbours)
+                  neigbour = remap[neigbour];
+               index.value(index.find(node.pos)) = index_t(ordered.size());
+               ordered.push_back(node);
+            }
+
+            nodes.swap(ordered);
+            alive.assign(nodes.size(), true);
+            dead = 0;
+         }
+
+      private:
+         static std::size_t const min_compaction = 1024;
+
+         std::vector<node_t> nodes;
+         std::vector<bool>   alive;
+         table_t             index;
+         std::size_t         dead = 0;
+      };
+   }
+
+   std::unique_ptr<storage_t> make_compact_storage()
+   {
+      return std::unique_ptr<storage_t>(new compact_storage_t);
+   }
+}
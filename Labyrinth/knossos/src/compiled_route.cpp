@@ -0,0 +1,206 @@
+#include <knossos/compiled_route.h>
+
+#include "navigation.h"
+#include "section_index.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+using boost::optional;
+
+namespace knossos
+{
+   namespace
+   {
+      typedef std::vector<section_id_t> table_t;
+
+      /// Таблица "сначала first, затем second"
+      table_t compose(table_t const & first, table_t const & second, unsigned num_threads)
+      {
+         table_t result(first.size());
+         parallel_for_stealing(first.size(), num_threads, 4096,
+            [&](std::size_t begin, std::size_t end)
+            {
+               for (auto i = begin; i != end; ++i)
+                  result[i] = second[first[i]];
+            });
+         return result;
+      }
+
+      /// Таблицы удвоения для маршрутов, повторённых до 2^63 раз
+      unsigned const max_levels = 64;
+   }
+
+   struct compiled_route_t::impl_t
+   {
+      template <class Walk>
+      impl_t(snapshot_t const & map, unsigned num_threads, Walk const & walk)
+         : map(map)
+         , index(std::make_shared<section_index_t>(*map.storage_))
+         , num_threads(num_threads)
+      {
+         auto const & storage = *map.storage_;
+         std::unique_ptr<table_t> table(new table_t(index->positions.size()));
+         parallel_for_stealing(table->size(), num_threads, 64,
+            [&](std::size_t begin, std::size_t end)
+            {
+               for (auto i = begin; i != end; ++i)
+               {
+                  auto const finish = walk(storage, *storage.find(index->positions[i]));
+                  (*table)[i] = *index->id(storage.position(finish));
+               }
+            });
+         jumps[0] = std::move(table);
+      }
+
+      impl_t(impl_t const & base, table_t && table)
+         : map(base.map)
+         , index(base.index)
+         , num_threads(base.num_threads)
+      {
+         jumps[0].reset(new table_t(std::move(table)));
+      }
+
+      /// Маршрут, повторённый 2^level раз; недостающие уровни достраиваются
+      table_t const & jump(unsigned level) const
+      {
+         if (level >= levels.load(std::memory_order_acquire))
+         {
+            std::lock_guard<std::mutex> guard(lock);
+            // Счёт идёт от последнего построенного уровня, а не от следующего:
+            // номер предыдущего уровня тогда не может уйти ниже нуля
+            // (уровень 0 есть всегда, max делает это видимым компилятору)
+            for (auto last = std::max(levels.load(std::memory_order_relaxed), 1u) - 1;
+                 last < level; ++last)
+            {
+               jumps[last + 1].reset(new table_t(compose(*jumps[last], *jumps[last],
+                                                         num_threads)));
+               levels.store(last + 2, std::memory_order_release);
+            }
+         }
+         return *jumps[level];
+      }
+
+      section_id_t apply(section_id_t id, std::uint64_t times) const
+      {
+         for (unsigned level = 0; times; ++level, times >>= 1)
+            if (times & 1)
+               id = jump(level)[id];
+         return id;
+      }
+
+      snapshot_t const map;
+      std::shared_ptr<section_index_t const> const index;
+      unsigned const num_threads;
+
+      mutable std::mutex                     lock;
+      mutable std::atomic<unsigned>          levels{1};
+      mutable std::unique_ptr<table_t const> jumps[max_levels];
+   };
+
+   ////////////////////////////////////////////////////////////////////////////
+
+   compiled_route_t::compiled_route_t(snapshot_t const & map,
+                                      direction_t const * first, direction_t const * last,
+                                      unsigned num_threads)
+      : pimpl_(std::make_shared<impl_t>(map, num_threads,
+           [first, last](storage_t const & storage, storage_t::handle_t start)
+           {
+              return storage.walk(start, first, last);
+           }))
+   {}
+
+   compiled_route_t::compiled_route_t(snapshot_t const & map,
+                                      route_run_t const * first, route_run_t const * last,
+                                      unsigned num_threads)
+   {
+      check_route_runs(first, last);
+      pimpl_ = std::make_shared<impl_t>(map, num_threads,
+         [first, last](storage_t const & storage, storage_t::handle_t start)
+         {
+            return storage.walk_runs(start, first, last);
+         });
+   }
+
+   compiled_route_t::compiled_route_t(std::shared_ptr<impl_t const> impl)
+      : pimpl_(std::move(impl))
+   {}
+
+   compiled_route_t::~compiled_route_t()
+   {}
+
+   snapshot_t const & compiled_route_t::map() const
+   {
+      return pimpl_->map;
+   }
+
+   optional<position_t> compiled_route_t::apply(position_t const & start,
+                                                std::uint64_t times) const
+   {
+      auto id = pimpl_->index->id(start);
+      if (!id)
+         return boost::none;
+      return pimpl_->index->positions[pimpl_->apply(*id, times)];
+   }
+
+   compiled_route_t compiled_route_t::then(compiled_route_t const & next) const
+   {
+      // Одно и то же хранилище нумерует секции одинаково
+      if (pimpl_->map.storage_ != next.pimpl_->map.storage_)
+         throw std::invalid_argument("routes are compiled for different maps");
+
+      return compiled_route_t(std::make_shared<impl_t>(*pimpl_,
+         compose(pimpl_->jump(0), next.pimpl_->jump(0), pimpl_->num_threads)));
+   }
+
+   compiled_route_t compiled_route_t::power(std::uint64_t times) const
+   {
+      if (times == 0)
+         throw std::invalid_argument("route power must be positive");
+
+      // Степени одного маршрута перестановочны, порядок композиции не важен
+      optional<table_t> table;
+      for (unsigned level = 0; times; ++level, times >>= 1)
+         if (times & 1)
+            table = table ? compose(*table, pimpl_->jump(level), pimpl_->num_threads)
+                          : pimpl_->jump(level);
+      return compiled_route_t(std::make_shared<impl_t>(*pimpl_, std::move(*table)));
+   }
+
+   optional<compiled_route_t::cycle_t> compiled_route_t::cycle(position_t const & start) const
+   {
+      auto first = pimpl_->index->id(start);
+      if (!first)
+         return boost::none;
+
+      // Алгоритм Брента: сначала длина цикла, затем длина предпериода
+      auto const & next = pimpl_->jump(0);
+      std::uint64_t power = 1, length = 1;
+      auto tortoise = *first, hare = next[*first];
+      while (tortoise != hare)
+      {
+         if (power == length)
+         {
+            tortoise = hare;
+            power *= 2;
+            length = 0;
+         }
+         hare = next[hare];
+         ++length;
+      }
+
+      std::uint64_t tail = 0;
+      tortoise = hare = *first;
+      for (std::uint64_t i = 0; i != length; ++i)
+         hare = next[hare];
+      for (; tortoise != hare; ++tail)
+      {
+         tortoise = next[tortoise];
+         hare = next[hare];
+      }
+      return cycle_t{tail, length};
+   }
+}
@@ -0,0 +1,149 @@
+#include "connectivity.h"
+#include "utils.h"
+
+#include <utility>
+
+
+namespace knossos
+{
+   connectivity_t::connectivity_t(storage_t const & storage)
+   {
+      ids.reserve(storage.size());
+      for (auto const & pos : storage.positions())
+         insert(pos);
+   }
+
+   void connectivity_t::insert(position_t const & pos)
+   {
+      if (ids.find(pos) == ids.npos)
+         link_neighbours(add(pos));
+   }
+
+   void connectivity_t::erase(position_t const & pos)
+   {
+      auto slot = ids.find(pos);
+      if (slot == ids.npos)
+         return;
+
+      auto const index = ids.value(slot);
+      ids.erase_slot(slot);
+      alive[index] = false;
+      dirty[find(index)] = true;
+
+      if (++dead > ids.size() && dead >= min_compaction)
+         compact();
+   }
+
+   bool connectivity_t::connected(position_t const & a, position_t const & b)
+   {
+      auto slot_a = ids.find(a), slot_b = ids.find(b);
+      if (slot_a == ids.npos || slot_b == ids.npos)
+         return false;
+
+      auto const index_a = ids.value(slot_a), index_b = ids.value(slot_b);
+      auto const root = find(index_a);
+
+      // Удаления только разбивают компоненты: разные корни - точно не связаны
+      if (root != find(index_b))
+         return false;
+      if (!dirty[root])
+         return true;
+
+      rebuild(root);
+      return find(index_a) == find(index_b);
+   }
+
+   connectivity_t::index_t connectivity_t::add(position_t const & pos)
+   {
+      auto const index = index_t(positions.size());
+      ids.value(ids.insert(pos).first) = index;
+      positions.push_back(pos);
+      parent.push_back(index);
+      size.push_back(1);
+      next.push_back(index);
+      alive.push_back(true);
+      dirty.push_back(false);
+      return index;
+   }
+
+   connectivity_t::index_t connectivity_t::find(index_t index)
+   {
+      // Сокращение путей делением пополам
+      while (parent[index] != index)
+      {
+         parent[index] = parent[parent[index]];
+         index = parent[index];
+      }
+      return index;
+   }
+
+   void connectivity_t::unite(index_t a, index_t b)
+   {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+         return;
+
+      if (size[a] < size[b])
+         std::swap(a, b);
+      parent[b] = a;
+      size[a] += size[b];
+      dirty[a] = dirty[a] || dirty[b];
+      std::swap(next[a], next[b]);
+   }
+
+   void connectivity_t::link_neighbours(index_t index)
+   {
+      for (auto dir : {dir_up, dir_left, dir_down, dir_right})
+      {
+         auto slot = ids.find(move(positions[index], dir));
+         if (slot != ids.npos)
+            unite(index, ids.value(slot));
+      }
+   }
+
+   void connectivity_t::rebuild(index_t root)
+   {
+      std::vector<index_t> members;
+      auto index = root;
+      do
+      {
+         members.push_back(index);
+         index = next[index];
+      }
+      while (index != root);
+
+      // Удалённые члены остаются одиночками, на них больше никто не ссылается
+      for (auto member : members)
+      {
+         parent[member] = member;
+         size[member]   = 1;
+         next[member]   = member;
+         dirty[member]  = false;
+      }
+      for (auto member : members)
+         if (alive[member])
+            link_neighbours(member);
+   }
+
+   void connectivity_t::compact()
+   {
+      std::vector<position_t> live;
+      live.reserve(ids.size());
+      for (std::size_t i = 0; i != positions.size(); ++i)
+         if (alive[i])
+            live.push_back(positions[i]);
+
+      ids.reset();
+      positions.clear();
+      parent.clear();
+      size.clear();
+      next.clear();
+      alive.clear();
+      dirty.clear();
+      dead = 0;
+
+      for (auto const & pos : live)
+         insert(pos);
+   }
+}
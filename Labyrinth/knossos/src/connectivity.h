@@ -0,0 +1,61 @@
+#pragma once
+
+#include "storage.h"
+#include "position_table.h"
+
+#include <vector>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Индекс компонент связности секций
+    *
+    * Система непересекающихся множеств (с объединением по размеру и
+    * сокращением путей) над номерами секций. Члены каждой компоненты
+    * дополнительно связаны в кольцевой список, который при объединении
+    * сшивается за O(1).
+    *
+    * Добавление секции объединяет её компоненту с компонентами соседей.
+    * Удаление может разбить компоненту, поэтому компонента только
+    * помечается, а при первом запросе к ней заново собирается по своему
+    * списку - за время, пропорциональное её размеру.
+    */
+   class connectivity_t
+   {
+   public:
+      explicit connectivity_t(storage_t const & storage);
+
+      void insert(position_t const & pos);
+      void erase(position_t const & pos);
+
+      /// Обе секции существуют и связаны
+      bool connected(position_t const & a, position_t const & b);
+
+   private:
+      typedef std::uint32_t index_t;
+
+      index_t add(position_t const & pos);
+      index_t find(index_t index);
+      void unite(index_t a, index_t b);
+      void link_neighbours(index_t index);
+
+      /// Заново собирает помеченную компоненту по её списку
+      void rebuild(index_t root);
+
+      /// Перестраивает весь индекс без удалённых секций
+      void compact();
+
+   private:
+      static std::size_t const min_compaction = 1024;
+
+      position_table_t<index_t> ids;
+      std::vector<position_t>   positions;
+      std::vector<index_t>      parent;
+      std::vector<index_t>      size;   ///< длина списка компоненты (у корня)
+      std::vector<index_t>      next;   ///< следующий член кольцевого списка
+      std::vector<bool>         alive;
+      std::vector<bool>         dirty;  ///< у корня: из компоненты удаляли секции
+      std::size_t               dead = 0;
+   };
+}
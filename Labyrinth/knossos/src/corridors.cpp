@@ -0,0 +1,259 @@
+#include "corridors.h"
+#include "storage.h"
+#include "bulk.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace knossos
+{
+   namespace
+   {
+      std::uint64_t distance(int from, int to)
+      {
+         return std::uint64_t(std::int64_t(to) - from);
+      }
+
+      std::int64_t const min_coord = std::numeric_limits<int>::min();
+      std::int64_t const max_coord = std::numeric_limits<int>::max();
+
+      /// Наибольшее w, для которого w * w <= value
+      std::int64_t isqrt(std::uint64_t value)
+      {
+         std::uint64_t const max_root = 0xffffffffu;
+         auto root = std::min(std::uint64_t(std::sqrt(double(value))), max_root);
+         while (root * root > value)
+            --root;
+         while (root != max_root && (root + 1) * (root + 1) <= value)
+            ++root;
+         return std::int64_t(root);
+      }
+
+      /// Столбцы прямоугольника, одинаковые во всех строках
+      struct rect_t
+      {
+         std::pair<std::int64_t, std::int64_t> operator() (int) const
+         {
+            return std::make_pair(std::int64_t(region.low.x), std::int64_t(region.high.x));
+         }
+
+         region_t region;
+      };
+
+      /// Половина ширины круга в строке на расстоянии dy от центра
+      struct disc_t
+      {
+         std::pair<std::int64_t, std::int64_t> operator() (int y) const
+         {
+            auto const dy = distance(std::min(y, center.y), std::max(y, center.y));
+            auto const w  = isqrt(std::uint64_t(radius) * radius - dy * dy);
+            return std::make_pair(center.x - w, center.x + w);
+         }
+
+         position_t    center;
+         std::uint32_t radius;
+      };
+   }
+
+   corridors_t::corridors_t(storage_t const & storage)
+   {
+      std::vector<position_t> positions;
+      positions.reserve(storage.size());
+      for (auto const & pos : storage.positions())
+         positions.push_back(pos);
+
+      columns_ = make_spans(positions, false);
+      rows_ = make_spans(positions, true);
+
+      row_counts_.reserve(rows_.size() + 1);
+      row_counts_.push_back(0);
+      for (auto const & span : rows_)
+         row_counts_.push_back(row_counts_.back() + distance(span.first, span.last) + 1);
+   }
+
+   std::vector<corridors_t::span_t> corridors_t::make_spans(std::vector<position_t> & positions,
+                                                            bool rows)
+   {
+      // Сортировка по (линия, координата вдоль неё): для строк это (y, x)
+      if (rows)
+         std::sort(positions.begin(), positions.end(),
+                   [](position_t const & l, position_t const & r)
+                   {
+                      return l.y < r.y || (l.y == r.y && l.x < r.x);
+                   });
+      else
+         std::sort(positions.begin(), positions.end(), column_order_t());
+
+      std::vector<span_t> spans;
+      for (auto const & pos : positions)
+      {
+         auto const line  = rows ? pos.y : pos.x;
+         auto const coord = rows ? pos.x : pos.y;
+         if (spans.empty() || spans.back().line != line || spans.back().last + 1 != coord)
+            spans.push_back(span_t{line, coord, coord});
+         else
+            spans.back().last = coord;
+      }
+      spans.shrink_to_fit();
+      return spans;
+   }
+
+   corridors_t::span_t const & corridors_t::find_span(std::vector<span_t> const & spans,
+                                                      int line, int coord)
+   {
+      // Последний отрезок, начинающийся не позже coord; секция в нём есть
+      auto it = std::upper_bound(spans.begin(), spans.end(), std::make_pair(line, coord),
+                                 [](std::pair<int, int> const & key, span_t const & span)
+                                 {
+                                    return key.first < span.line
+                                       || (key.first == span.line && key.second < span.first);
+                                 });
+      return *--it;
+   }
+
+   std::uint64_t corridors_t::reach(position_t const & pos, direction_t dir) const
+   {
+      switch (dir)
+      {
+      case dir_right: return distance(pos.x, find_span(rows_, pos.y, pos.x).last);
+      case dir_left:  return distance(find_span(rows_, pos.y, pos.x).first, pos.x);
+      case dir_up:    return distance(pos.y, find_span(columns_, pos.x, pos.y).last);
+      case dir_down:  return distance(find_span(columns_, pos.x, pos.y).first, pos.y);
+      default:
+         assert(false);
+         return 0;
+      }
+   }
+
+   position_t corridors_t::walk(position_t pos, route_run_t const * first,
+                                route_run_t const * last) const
+   {
+      std::uint64_t total = 0, blocked = 0;
+      for (; first != last; ++first)
+      {
+         // Шаг в стену не меняет положения, поэтому участок
+         // заканчивается у стены, даже если он длиннее коридора
+         auto const steps = int(std::min(first->count, reach(pos, first->dir)));
+         switch (first->dir)
+         {
+         case dir_right: pos.x += steps; break;
+         case dir_left:  pos.x -= steps; break;
+         case dir_up:    pos.y += steps; break;
+         case dir_down:  pos.y -= steps; break;
+         default:        break;
+         }
+
+         if (stats_enabled)
+         {
+            total   += first->count;
+            blocked += first->count - std::uint64_t(steps);
+         }
+      }
+      count_steps(total, blocked);
+      return pos;
+   }
+
+   template <class Bounds, class Visit>
+   void corridors_t::scan(std::int64_t y_first, std::int64_t y_last,
+                          Bounds const & bounds, Visit const & visit) const
+   {
+      y_first = std::max(y_first, min_coord);
+      y_last  = std::min(y_last, max_coord);
+
+      auto const end = rows_.end();
+      auto it = std::lower_bound(rows_.begin(), end, y_first,
+                                 [](span_t const & span, std::int64_t y) { return span.line < y; });
+
+      while (it != end && it->line <= y_last)
+      {
+         int const y = it->line;
+         auto const range = bounds(y);
+
+         // Отрезки строки отсортированы и по началу, и по концу
+         auto last = it;
+         if (range.first <= range.second)
+         {
+            auto first = std::lower_bound(it, end, range.first,
+                                          [y](span_t const & span, std::int64_t x)
+                                          {
+                                             return span.line == y && span.last < x;
+                                          });
+            last = std::lower_bound(first, end, range.second,
+                                    [y](span_t const & span, std::int64_t x)
+                                    {
+                                       return span.line == y && span.first <= x;
+                                    });
+            if (first != last)
+               visit(y, first, last, range.first, range.second);
+         }
+
+         it = std::lower_bound(last, end, y,
+                               [](span_t const & span, int line) { return span.line <= line; });
+      }
+   }
+
+   template <class Bounds>
+   void corridors_t::list(std::int64_t y_first, std::int64_t y_last, Bounds const & bounds,
+                          std::vector<position_t> & out) const
+   {
+      out.clear();
+      scan(y_first, y_last, bounds,
+           [&out](int y, span_iterator_t first, span_iterator_t last,
+                  std::int64_t x_first, std::int64_t x_last)
+           {
+              for (; first != last; ++first)
+              {
+                 auto const to = int(std::min<std::int64_t>(first->last, x_last));
+                 for (auto x = int(std::max<std::int64_t>(first->first, x_first));; ++x)
+                 {
+                    out.emplace_back(x, y);
+                    if (x == to)
+                       break;
+                 }
+              }
+           });
+   }
+
+   template <class Bounds>
+   std::uint64_t corridors_t::count(std::int64_t y_first, std::int64_t y_last,
+                                    Bounds const & bounds) const
+   {
+      std::uint64_t total = 0;
+      scan(y_first, y_last, bounds,
+           [&](int, span_iterator_t first, span_iterator_t last,
+               std::int64_t x_first, std::int64_t x_last)
+           {
+              // Целые отрезки по префиксным суммам, крайние обрезаются
+              total += row_counts_[last - rows_.begin()] - row_counts_[first - rows_.begin()];
+              total -= std::uint64_t(std::max<std::int64_t>(0, x_first - first->first));
+              total -= std::uint64_t(std::max<std::int64_t>(0, (last - 1)->last - x_last));
+           });
+      return total;
+   }
+
+   void corridors_t::sections(region_t const & region, std::vector<position_t> & out) const
+   {
+      list(region.low.y, region.high.y, rect_t{region}, out);
+   }
+
+   std::uint64_t corridors_t::count(region_t const & region) const
+   {
+      return count(region.low.y, region.high.y, rect_t{region});
+   }
+
+   void corridors_t::sections(position_t const & center, std::uint32_t radius,
+                              std::vector<position_t> & out) const
+   {
+      list(std::int64_t(center.y) - radius, std::int64_t(center.y) + radius,
+           disc_t{center, radius}, out);
+   }
+
+   std::uint64_t corridors_t::count(position_t const & center, std::uint32_t radius) const
+   {
+      return count(std::int64_t(center.y) - radius, std::int64_t(center.y) + radius,
+                   disc_t{center, radius});
+   }
+}
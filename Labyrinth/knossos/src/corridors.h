@@ -0,0 +1,83 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <vector>
+
+
+namespace knossos
+{
+   struct storage_t;
+
+   /*!
+    * \brief Индекс коридоров - отрезков подряд идущих секций
+    *
+    * Для каждой строки хранятся её горизонтальные отрезки, для каждого
+    * столбца - вертикальные, все отсортированы по (линия, начало).
+    * Сколько шагов можно сделать от секции в заданном направлении,
+    * находится двоичным поиском её отрезка, так что участок маршрута
+    * любой длины проходится за O(log n).
+    *
+    * По отрезкам строк (с префиксными суммами длин) отвечают и запросы
+    * к областям: каждая непустая строка области находится двоичным
+    * поиском, поэтому перечисление стоит O(k log n + m), а подсчёт -
+    * O(k log n), где k - число непустых строк области, m - число секций.
+    */
+   class corridors_t
+   {
+   public:
+      explicit corridors_t(storage_t const & storage);
+
+      /// Число шагов от секции pos в направлении dir до стены
+      std::uint64_t reach(position_t const & pos, direction_t dir) const;
+
+      /// Конечная точка маршрута из участков, начиная с секции pos
+      position_t walk(position_t pos, route_run_t const * first, route_run_t const * last) const;
+
+      /// Секции прямоугольника по строкам снизу вверх, в строке - слева направо
+      void sections(region_t const & region, std::vector<position_t> & out) const;
+      std::uint64_t count(region_t const & region) const;
+
+      /// Секции не дальше radius от center (по евклидову расстоянию)
+      void sections(position_t const & center, std::uint32_t radius,
+                    std::vector<position_t> & out) const;
+      std::uint64_t count(position_t const & center, std::uint32_t radius) const;
+
+   private:
+      struct span_t
+      {
+         int line;   ///< y для строки, x для столбца
+         int first;  ///< первая координата вдоль линии
+         int last;   ///< последняя координата вдоль линии
+      };
+
+      static std::vector<span_t> make_spans(std::vector<position_t> & positions, bool rows);
+
+      static span_t const & find_span(std::vector<span_t> const & spans, int line, int coord);
+
+      typedef std::vector<span_t>::const_iterator span_iterator_t;
+
+      /*!
+       * Для каждой непустой строки y из [y_first, y_last] вызывает
+       * visit(y, first, last, x_first, x_last), где [first, last) -
+       * отрезки строки, пересекающие [x_first, x_last] = bounds(y)
+       */
+      template <class Bounds, class Visit>
+      void scan(std::int64_t y_first, std::int64_t y_last,
+                Bounds const & bounds, Visit const & visit) const;
+
+      template <class Bounds>
+      void list(std::int64_t y_first, std::int64_t y_last, Bounds const & bounds,
+                std::vector<position_t> & out) const;
+
+      template <class Bounds>
+      std::uint64_t count(std::int64_t y_first, std::int64_t y_last, Bounds const & bounds) const;
+
+   private:
+      std::vector<span_t> rows_;
+      std::vector<span_t> columns_;
+
+      /// Число секций в rows_ до каждого отрезка, последний элемент - всего
+      std::vector<std::uint64_t> row_counts_;
+   };
+}
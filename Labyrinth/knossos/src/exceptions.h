@@ -20,4 +20,36 @@ namespace knossos
          return "incorrect start position";
       }
    };
+
+   struct invalid_direction_error_t : route_error_t
+   {
+      const char *what() const noexcept override
+      {
+         return "invalid route direction";
+      }
+   };
+
+   struct state_io_error_t : state_error_t
+   {
+      const char *what() const noexcept override
+      {
+         return "failed to read or write labyrinth state file";
+      }
+   };
+
+   struct state_format_error_t : state_error_t
+   {
+      const char *what() const noexcept override
+      {
+         return "not a labyrinth state file or unsupported version";
+      }
+   };
+
+   struct state_corrupt_error_t : state_error_t
+   {
+      const char *what() const noexcept override
+      {
+         return "labyrinth state file is corrupt";
+      }
+   };
 }
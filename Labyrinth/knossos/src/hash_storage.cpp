@@ -0,0 +1,142 @@
+#include "storage.h"
+#include "position_table.h"
+#include "state_file.h"
+#include "utils.h"
+
+#include <boost/range/adaptor/filtered.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/counting_range.hpp>
+
+namespace ba = boost::adaptors;
+using boost::optional;
+
+namespace knossos
+{
+   namespace
+   {
+      typedef position_table_t<> position_set_t;
+
+      struct slot_occupied_t
+      {
+         position_set_t const * table;
+
+         bool operator() (std::size_t slot) const
+         {
+            return table->occupied(slot);
+         }
+      };
+
+      struct slot_position_t
+      {
+         position_set_t const * table;
+
+         position_t operator() (std::size_t slot) const
+         {
+            return table->position(slot);
+         }
+      };
+
+      /*!
+       * Хранение секций в хеш-таблице с открытой адресацией.
+       * Ссылки на соседей не хранятся: каждый шаг - поиск соседних
+       * координат в таблице, дескриптор - номер ячейки таблицы.
+       */
+      struct hash_storage_t : storage_base_t<hash_storage_t>
+      {
+         std::unique_ptr<storage_t> clone() const override
+         {
+            return std::unique_ptr<storage_t>(new hash_storage_t(*this));
+         }
+
+         bool insert(position_t const & pos) override
+         {
+            return table.insert(pos).second;
+         }
+
+         void insert_bulk(std::vector<position_t> & sections, unsigned) override
+         {
+            table.reserve(table.size() + sections.size());
+            for (auto const & pos : sections)
+               table.insert(pos);
+         }
+
+         void reserve(std::size_t count) override
+         {
+            table.reserve(count);
+         }
+
+         bool erase(position_t const & pos) override
+         {
+            return table.erase(pos);
+         }
+
+         std::size_t size() const override
+         {
+            return table.size();
+         }
+
+         positions_range_t positions() const override
+         {
+            return boost::counting_range(std::size_t(0), table.capacity())
+               | ba::filtered(slot_occupied_t{&table})
+               | ba::transformed(slot_position_t{&table});
+         }
+
+         optional<handle_t> find(position_t const & pos) const override
+         {
+            auto slot = table.find(pos);
+            if (slot == position_set_t::npos)
+               return boost::none;
+            return handle_t(slot);
+         }
+
+         position_t position(handle_t handle) const override
+         {
+            return table.position(std::size_t(handle));
+         }
+
+         void save(state_writer_t & out) const override
+         {
+            table.save(out);
+         }
+
+         void load(state_reader_t & in) override
+         {
+            if (!table.load(in))
+               throw state_corrupt_error_t();
+         }
+
+         struct cursor_t
+         {
+            std::size_t slot;
+            position_t  pos;
+         };
+
+         cursor_t cursor(handle_t handle) const
+         {
+            return cursor_t{std::size_t(handle), table.position(std::size_t(handle))};
+         }
+
+         static handle_t handle(cursor_t const & cursor)
+         {
+            return cursor.slot;
+         }
+
+         void step(cursor_t & cursor, direction_t dir) const
+         {
+            auto next = move(cursor.pos, dir);
+            auto slot = table.find(next);
+            if (slot != position_set_t::npos)
+               cursor = cursor_t{slot, next};
+         }
+
+      private:
+         position_set_t table;
+      };
+   }
+
+   std::unique_ptr<storage_t> make_hash_storage()
+   {
+      return std::unique_ptr<storage_t>(new hash_storage_t);
+   }
+}
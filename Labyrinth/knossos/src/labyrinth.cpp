@@ -1,75 +1,86 @@
-#include "utils.h"
-#include "exceptions.h"
+#include <knossos/snapshot.h>
+#include <knossos/path_finder.h>
 
-#include <set>
-#include <array>
-#include <assert.h>
+#include "navigation.h"
+#include "connectivity.h"
+#include "corridors.h"
+#include "state_file.h"
+#include "stats.h"
 
-#include <boost/range/adaptor/transformed.hpp>
+#include <atomic>
 
-namespace ba = boost::adaptors;
 using boost::optional;
 
 namespace knossos
 {
-   namespace
+   struct labyrinth_t::impl_t
    {
-      struct section_t : position_t
-      {
-         section_t( position_t const & pos )
-            : position_t(pos)
-            , neigbours{{}}
-         {}
-
-         section_t( int x = 0, int y = 0 )
-            : section_t(position_t(x, y))
-         {}
-
-         typedef
-            std::array<section_t const *, direction_t::total_num>
-            neigbours_t;
+      explicit impl_t(storage_type_t type)
+         : type(type)
+         , storage(make_storage(type))
+      {}
 
-         mutable neigbours_t neigbours;
-      };
-
-      struct section_compare_t
+      navigation_t navigation()
       {
-         using is_transparent = void;
+         return navigation_t{*storage, current, current_pos};
+      }
 
-         bool operator() (section_t const &ls, section_t const &rs) const
+      /*!
+       * Хранилище для изменения. Если его разделяет хотя бы один снимок,
+       * лабиринт сначала получает собственную копию (копирование при записи).
+       * Снимки создаются только этим же потоком, а published() из других
+       * потоков копирует уже разделяемое хранилище, поэтому счётчик ссылок
+       * не может вырасти с 1 во время проверки. Если же он равен 1, барьер
+       * упорядочивает чтения отпустивших снимки потоков перед изменением.
+       */
+      storage_t & modify()
+      {
+         if (storage.use_count() != 1)
+            storage = storage->clone();
+         else
          {
-            return ls.x < rs.x || (ls.x == rs.x && ls.y < rs.y);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            storage->reset_corridors();
          }
-      };
-   }
 
-   ////////////////////////////////////////////////////////////////////////////
+         ++version;
+         return *storage;
+      }
 
-   struct labyrinth_t::impl_t
-   {
-      std::set<section_t, section_compare_t> sections;
-      section_t const * current_pos = nullptr;
+      storage_type_t type;
+      std::shared_ptr<storage_t> storage;
+      std::uint64_t version = 0;
 
-      section_t const * find_section(position_t const & pos) const
-      {
-         auto itr = sections.find(pos);
-         if (itr == sections.end())
-            return nullptr;
-         return &(*itr);
-      }
+      /// Доступ только через std::atomic_load/atomic_store
+      std::shared_ptr<snapshot_t const> published;
+
+      path_finder_t finder;
+
+      /// Строится при первом is_reachable, затем поддерживается изменениями
+      std::unique_ptr<connectivity_t> connectivity;
+
+      optional<storage_t::handle_t> current;
+      position_t current_pos;
    };
 
    ////////////////////////////////////////////////////////////////////////////
 
    labyrinth_t::labyrinth_t()
-      : pimpl_(new impl_t)
+      : labyrinth_t(storage_tree)
    {}
 
+   labyrinth_t::labyrinth_t(storage_type_t storage)
+      : pimpl_(new impl_t(storage))
+   {
+      publish();
+   }
+
    labyrinth_t::labyrinth_t(positions_range_t sections,
-                            optional<position_t> const & start_pos)
-      : labyrinth_t()
+                            optional<position_t> const & start_pos,
+                            storage_type_t storage)
+      : labyrinth_t(storage)
    {
-      add_sections(sections);
+      add_sections(std::vector<position_t>(sections.begin(), sections.end()));
       if (start_pos)
          if (!set_position(*start_pos))
             throw incorrect_position_error_t();
@@ -78,90 +89,278 @@ namespace knossos
    labyrinth_t::~labyrinth_t()
    {}
 
+   storage_type_t labyrinth_t::storage() const
+   {
+      return pimpl_->type;
+   }
+
    void labyrinth_t::add_sections(positions_range_t sections)
    {
+      phase_timer_t timer(phase_build);
+      auto & storage = pimpl_->modify();
+      auto * connectivity = pimpl_->connectivity.get();
+      std::uint64_t inserted = 0, skipped = 0;
       for (position_t pos : sections)
       {
-         auto result = pimpl_->sections.emplace(pos);
-         if (result.second)
-         {
-            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
-            {
-               if (auto section = pimpl_->find_section(move(pos, dir)))
-               {
-                  result.first->neigbours[dir] = section;
-                  section->neigbours[opposite_direction(dir)] = &(*result.first);
-               }
-            }
-         }
+         if (storage.insert(pos))
+            ++inserted;
+         else
+            ++skipped;
+         if (connectivity)
+            connectivity->insert(pos);
       }
+      count(counters.sections_inserted, inserted);
+      count(counters.duplicates_skipped, skipped);
+
+      pimpl_->navigation().update();
+   }
+
+   void labyrinth_t::add_sections(std::vector<position_t> && sections, unsigned num_threads)
+   {
+      phase_timer_t timer(phase_build);
+      auto & storage = pimpl_->modify();
+      auto const before = stats_enabled ? storage.size() : 0;
+      auto const total = sections.size();
+      storage.insert_bulk(sections, num_threads);
+      if (stats_enabled)
+      {
+         auto const inserted = storage.size() - before;
+         count(counters.sections_inserted, inserted);
+         count(counters.duplicates_skipped, total - inserted);
+      }
+
+      if (auto * connectivity = pimpl_->connectivity.get())
+         for (auto const & pos : sections)
+            connectivity->insert(pos);
+
+      pimpl_->navigation().update();
+   }
+
+   void labyrinth_t::add_sections(position_t const * first, position_t const * last)
+   {
+      phase_timer_t timer(phase_build);
+      auto & storage = pimpl_->modify();
+      auto * connectivity = pimpl_->connectivity.get();
+      auto const total = std::uint64_t(last - first);
+      std::uint64_t inserted = 0;
+      for (; first != last; ++first)
+      {
+         inserted += storage.insert(*first);
+         if (connectivity)
+            connectivity->insert(*first);
+      }
+      count(counters.sections_inserted, inserted);
+      count(counters.duplicates_skipped, total - inserted);
+
+      pimpl_->navigation().update();
+   }
+
+   void labyrinth_t::reserve(std::size_t count)
+   {
+      phase_timer_t timer(phase_build);
+      pimpl_->modify().reserve(count);
    }
 
    void labyrinth_t::remove_sections(positions_range_t sections)
    {
+      phase_timer_t timer(phase_remove);
+      auto & storage = pimpl_->modify();
+      auto * connectivity = pimpl_->connectivity.get();
+      std::uint64_t removed = 0;
       for (position_t pos : sections)
       {
-         auto itr = pimpl_->sections.find(pos);
-         if (itr != pimpl_->sections.end())
-         {
-            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
-               if (auto neigbour = itr->neigbours[dir])
-                  neigbour->neigbours[opposite_direction(dir)] = nullptr;
+         removed += storage.erase(pos);
+         if (connectivity)
+            connectivity->erase(pos);
+      }
+      count(counters.sections_removed, removed);
 
-            if (pimpl_->current_pos == &(*itr))
-               pimpl_->current_pos = nullptr;
+      pimpl_->navigation().update();
+   }
 
-            pimpl_->sections.erase(itr);
-         }
+   void labyrinth_t::optimize()
+   {
+      phase_timer_t timer(phase_optimize);
+      pimpl_->modify().optimize();
+      pimpl_->navigation().update();
+   }
+
+   void labyrinth_t::save(std::string const & path) const
+   {
+      phase_timer_t timer(phase_save);
+      optional<position_t> position;
+      if (pimpl_->current)
+         position = pimpl_->current_pos;
+      save_state(path, pimpl_->type, *pimpl_->storage, position);
+   }
+
+   void labyrinth_t::load(std::string const & path)
+   {
+      phase_timer_t timer(phase_load);
+      auto state = load_state(path);
+      optional<storage_t::handle_t> current;
+      if (state.position)
+      {
+         current = state.storage->find(*state.position);
+         if (!current)
+            throw state_corrupt_error_t();
       }
+
+      // Снимки прежней карты остаются при своём хранилище
+      auto & impl = *pimpl_;
+      impl.type = state.type;
+      impl.storage = std::move(state.storage);
+      impl.connectivity.reset();
+      impl.current = current;
+      if (state.position)
+         impl.current_pos = *state.position;
+      ++impl.version;
    }
 
    positions_range_t labyrinth_t::sections() const
    {
-      return pimpl_->sections | ba::transformed(
-         [](section_t const & section)
-         {
-            return static_cast<position_t const &>(section);
-         });
+      return pimpl_->storage->positions();
+   }
+
+   void labyrinth_t::sections_in(region_t const & region, std::vector<position_t> & out) const
+   {
+      pimpl_->storage->corridors().sections(region, out);
+   }
+
+   std::uint64_t labyrinth_t::count_in(region_t const & region) const
+   {
+      return pimpl_->storage->corridors().count(region);
+   }
+
+   void labyrinth_t::sections_within(position_t const & center, std::uint32_t radius,
+                                     std::vector<position_t> & out) const
+   {
+      pimpl_->storage->corridors().sections(center, radius, out);
+   }
+
+   std::uint64_t labyrinth_t::count_within(position_t const & center, std::uint32_t radius) const
+   {
+      return pimpl_->storage->corridors().count(center, radius);
+   }
+
+   snapshot_t labyrinth_t::snapshot() const
+   {
+      return snapshot_t(pimpl_->storage, pimpl_->version);
+   }
+
+   void labyrinth_t::publish()
+   {
+      std::atomic_store(&pimpl_->published,
+                        std::shared_ptr<snapshot_t const>(new snapshot_t(snapshot())));
+   }
+
+   snapshot_t labyrinth_t::published() const
+   {
+      return *std::atomic_load(&pimpl_->published);
+   }
+
+   std::uint64_t labyrinth_t::version() const
+   {
+      return pimpl_->version;
    }
 
    bool labyrinth_t::set_position(position_t const & position)
    {
-      if (auto section = pimpl_->find_section(position))
-      {
-         pimpl_->current_pos = section;
-         return true;
-      }
-      return false;
+      return pimpl_->navigation().set_position(position);
    }
 
    bool labyrinth_t::is_position_set() const
    {
-      return pimpl_->current_pos != nullptr;
+      return pimpl_->current.is_initialized();
    }
 
    position_t const & labyrinth_t::position() const
    {
-      if (!pimpl_->current_pos)
+      if (!pimpl_->current)
          throw position_not_set_error_t();
 
-      return *pimpl_->current_pos;
+      return pimpl_->current_pos;
    }
 
    position_t const & labyrinth_t::navigate(directions_range_t route,
                                             optional<position_t> const & start_pos)
    {
-      if (start_pos && !set_position(*start_pos))
-         throw incorrect_position_error_t();
-      if (!pimpl_->current_pos)
+      auto nav = pimpl_->navigation();
+      return nav.finish(nav.storage.walk(nav.start(start_pos), route));
+   }
+
+   position_t const & labyrinth_t::navigate(direction_t const * first, direction_t const * last,
+                                            optional<position_t> const & start_pos)
+   {
+      auto nav = pimpl_->navigation();
+      return nav.finish(nav.storage.walk(nav.start(start_pos), first, last));
+   }
+
+   position_t const & labyrinth_t::navigate(std::uint8_t const * route, std::size_t length,
+                                            optional<position_t> const & start_pos)
+   {
+      check_direction_codes(route, length);
+
+      auto nav = pimpl_->navigation();
+      return nav.finish(nav.storage.walk(nav.start(start_pos), route, route + length));
+   }
+
+   position_t const & labyrinth_t::navigate(direction_t const * first, direction_t const * last,
+                                            route_trace_t & trace,
+                                            optional<position_t> const & start_pos)
+   {
+      return pimpl_->navigation().trace(first, last, trace, start_pos);
+   }
+
+   position_t const & labyrinth_t::navigate(route_run_t const * first, route_run_t const * last,
+                                            optional<position_t> const & start_pos)
+   {
+      check_route_runs(first, last);
+
+      auto nav = pimpl_->navigation();
+      return nav.finish(nav.storage.walk_runs(nav.start(start_pos), first, last));
+   }
+
+   bool labyrinth_t::find_route(position_t const & to, std::vector<direction_t> & route,
+                                optional<position_t> const & start_pos,
+                                search_algorithm_t algorithm)
+   {
+      if (!start_pos && !pimpl_->current)
          throw position_not_set_error_t();
 
-      for (auto dir : route)
-         if (auto next = pimpl_->current_pos->neigbours[dir])
-            pimpl_->current_pos = next;
+      auto const from = start_pos ? *start_pos : pimpl_->current_pos;
+      return pimpl_->finder.find_route(*pimpl_->storage, from, to, route, algorithm);
+   }
+
+   bool labyrinth_t::is_reachable(position_t const & from, position_t const & to)
+   {
+      auto & connectivity = pimpl_->connectivity;
+      if (!connectivity)
+      {
+         phase_timer_t timer(phase_index);
+         connectivity.reset(new connectivity_t(*pimpl_->storage));
+      }
+
+      return connectivity->connected(from, to);
+   }
 
-      return *pimpl_->current_pos;
+   void labyrinth_t::navigate_batch(std::vector<route_query_t> const & queries,
+                                    std::vector<optional<position_t>> & results,
+                                    unsigned num_threads) const
+   {
+      snapshot().navigate_batch(queries, results, num_threads);
    }
 
    ////////////////////////////////////////////////////////////////////////////
+
+   std::vector<route_run_t> encode_runs(direction_t const * first, direction_t const * last)
+   {
+      std::vector<route_run_t> runs;
+      for (; first != last; ++first)
+         if (!runs.empty() && runs.back().dir == *first)
+            ++runs.back().count;
+         else
+            runs.push_back(route_run_t{*first, 1});
+      return runs;
+   }
 }
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "storage.h"
+#include "exceptions.h"
+
+
+namespace knossos
+{
+   /*!
+    * \brief Общая логика текущего положения для labyrinth_t и cursor_t
+    *
+    * Связывает хранилище с дескриптором текущей секции и её координатами,
+    * которые хранит владелец.
+    */
+   struct navigation_t
+   {
+      typedef storage_t::handle_t handle_t;
+
+      storage_t const &           storage;
+      boost::optional<handle_t> & current;
+      position_t &                current_pos;
+
+      bool set_position(position_t const & pos)
+      {
+         count(counters.lookups, 1);
+         if (auto section = storage.find(pos))
+         {
+            current = section;
+            current_pos = pos;
+            return true;
+         }
+         return false;
+      }
+
+      /// Начало маршрута: текущая секция либо start_pos
+      handle_t start(boost::optional<position_t> const & start_pos)
+      {
+         if (start_pos && !set_position(*start_pos))
+            throw incorrect_position_error_t();
+         if (!current)
+            throw position_not_set_error_t();
+
+         return *current;
+      }
+
+      position_t const & finish(handle_t handle)
+      {
+         current = handle;
+         current_pos = storage.position(handle);
+         return current_pos;
+      }
+
+      /// Навигация с записью пути от начальной секции
+      position_t const & trace(direction_t const * first, direction_t const * last,
+                               route_trace_t & trace, boost::optional<position_t> const & start_pos)
+      {
+         return finish(storage.walk(start(start_pos), first, last, trace));
+      }
+
+      /// Дескрипторы хранилища устаревают после его изменения,
+      /// поэтому текущая секция заново ищется по координатам
+      void update()
+      {
+         if (current)
+            current = storage.find(current_pos);
+      }
+   };
+
+   /// Проверка байтовых кодов направлений, см. labyrinth_t::navigate
+   inline void check_direction_codes(std::uint8_t const * route, std::size_t length)
+   {
+      // Все коды меньше 4 тогда и только тогда, когда их OR меньше 4;
+      // такой проход без ветвлений векторизуется компилятором
+      std::uint8_t codes = 0;
+      for (std::size_t i = 0; i != length; ++i)
+         codes |= route[i];
+      if (codes >= total_num)
+         throw invalid_direction_error_t();
+   }
+
+   /// Проверка направлений участков маршрута
+   inline void check_route_runs(route_run_t const * first, route_run_t const * last)
+   {
+      for (; first != last; ++first)
+         if (unsigned(first->dir) >= total_num)
+            throw invalid_direction_error_t();
+   }
+}
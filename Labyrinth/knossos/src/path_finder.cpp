@@ -0,0 +1,217 @@
+#include <knossos/path_finder.h>
+
+#include "storage.h"
+#include "position_table.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace knossos
+{
+   namespace
+   {
+      /// Как секция достигнута: длина маршрута и направление последнего шага
+      struct visit_t
+      {
+         std::uint32_t cost;
+         std::uint8_t  dir;   ///< total_num у начальной секции
+      };
+
+      struct queued_t
+      {
+         storage_t::handle_t handle;
+         position_t          pos;
+      };
+
+      /// Элемент кучи A*: оценка полной длины и пройденная длина
+      struct open_t
+      {
+         std::uint64_t       estimate;
+         std::uint32_t       cost;
+         storage_t::handle_t handle;
+         position_t          pos;
+      };
+
+      /// Порядок для std::*_heap: сверху наименьшая оценка, при равенстве -
+      /// большая пройденная длина (такая секция ближе к цели)
+      struct worse_t
+      {
+         bool operator() (open_t const & l, open_t const & r) const
+         {
+            return l.estimate > r.estimate || (l.estimate == r.estimate && l.cost < r.cost);
+         }
+      };
+
+      std::uint64_t manhattan(position_t const & l, position_t const & r)
+      {
+         return std::uint64_t(std::llabs(std::int64_t(l.x) - r.x))
+              + std::uint64_t(std::llabs(std::int64_t(l.y) - r.y));
+      }
+
+      direction_t const directions[] = {dir_up, dir_left, dir_down, dir_right};
+   }
+
+   struct path_finder_t::impl_t
+   {
+      bool bfs(storage_t const & storage, storage_t::handle_t start,
+               position_t const & from, position_t const & to)
+      {
+         queue.clear();
+         queue.push_back(queued_t{start, from});
+
+         for (std::size_t head = 0; head != queue.size(); ++head)
+         {
+            auto const current = queue[head];
+            auto const cost = visited.value(visited.find(current.pos)).cost + 1;
+
+            for (auto dir : directions)
+            {
+               auto const next = storage.neighbour(current.handle, dir);
+               if (next == current.handle)
+                  continue;
+
+               auto const pos = move(current.pos, dir);
+               auto const slot = visit(pos);
+               if (!slot.second)
+                  continue;
+
+               visited.value(slot.first) = visit_t{cost, std::uint8_t(dir)};
+               if (pos == to)
+                  return true;
+               queue.push_back(queued_t{next, pos});
+            }
+         }
+         return false;
+      }
+
+      bool astar(storage_t const & storage, storage_t::handle_t start,
+                 position_t const & from, position_t const & to)
+      {
+         heap.clear();
+         heap.push_back(open_t{manhattan(from, to), 0, start, from});
+
+         while (!heap.empty())
+         {
+            std::pop_heap(heap.begin(), heap.end(), worse_t());
+            auto const current = heap.back();
+            heap.pop_back();
+
+            // Устаревшая запись: секцию уже достигли короче
+            if (visited.value(visited.find(current.pos)).cost != current.cost)
+               continue;
+            if (current.pos == to)
+               return true;
+
+            auto const cost = current.cost + 1;
+            for (auto dir : directions)
+            {
+               auto const next = storage.neighbour(current.handle, dir);
+               if (next == current.handle)
+                  continue;
+
+               auto const pos = move(current.pos, dir);
+               auto const slot = this->visit(pos);
+               auto & visit = visited.value(slot.first);
+               if (!slot.second && visit.cost <= cost)
+                  continue;
+
+               visit = visit_t{cost, std::uint8_t(dir)};
+               heap.push_back(open_t{cost + manhattan(pos, to), cost, next, pos});
+               std::push_heap(heap.begin(), heap.end(), worse_t());
+            }
+         }
+         return false;
+      }
+
+      /// Добавляет секцию в посещённые, запоминая ячейку для clear()
+      std::pair<std::size_t, bool> visit(position_t const & pos)
+      {
+         auto const slot = visited.insert(pos);
+         if (slot.second)
+            touched.push_back(slot.first);
+         return slot;
+      }
+
+      /*!
+       * Очистка посещённых перед поиском. Обычно очищаются только ячейки
+       * прошлого поиска, так что короткий запрос после большого не платит
+       * за проход по всей таблице. Если таблица с тех пор выросла,
+       * ячейки сдвинулись, и она очищается целиком - это время уже
+       * окуплено поиском, которому понадобилось её увеличить.
+       */
+      void clear()
+      {
+         if (visited.capacity() == cleared_capacity)
+            visited.reset(touched);
+         else
+            visited.reset();
+         touched.clear();
+         cleared_capacity = visited.capacity();
+      }
+
+      /// Маршрут восстанавливается от цели по направлениям последних шагов
+      void restore(position_t pos, std::vector<direction_t> & route) const
+      {
+         for (;;)
+         {
+            auto const dir = visited.value(visited.find(pos)).dir;
+            if (dir == total_num)
+               break;
+            route.push_back(direction_t(dir));
+            pos = move(pos, opposite_direction(direction_t(dir)));
+         }
+         std::reverse(route.begin(), route.end());
+      }
+
+      position_table_t<visit_t> visited;
+      std::vector<std::size_t>  touched;            ///< ячейки visited с ключами
+      std::size_t               cleared_capacity = 0;
+      std::vector<queued_t>     queue;
+      std::vector<open_t>       heap;
+   };
+
+   ////////////////////////////////////////////////////////////////////////////
+
+   path_finder_t::path_finder_t()
+      : pimpl_(new impl_t)
+   {}
+
+   path_finder_t::~path_finder_t()
+   {}
+
+   bool path_finder_t::find_route(snapshot_t const & map,
+                                  position_t const & from, position_t const & to,
+                                  std::vector<direction_t> & route,
+                                  search_algorithm_t algorithm)
+   {
+      return find_route(*map.storage_, from, to, route, algorithm);
+   }
+
+   bool path_finder_t::find_route(storage_t const & storage,
+                                  position_t const & from, position_t const & to,
+                                  std::vector<direction_t> & route,
+                                  search_algorithm_t algorithm)
+   {
+      auto & impl = *pimpl_;
+      impl.clear();
+      route.clear();
+
+      auto const start = storage.find(from);
+      if (!start || !storage.find(to))
+         return false;
+
+      impl.visited.value(impl.visit(from).first) = visit_t{0, std::uint8_t(total_num)};
+      bool const found = from == to
+         || (algorithm == search_bfs ? impl.bfs(storage, *start, from, to)
+                                     : impl.astar(storage, *start, from, to));
+      if (found)
+         impl.restore(to, route);
+      return found;
+   }
+
+   std::size_t path_finder_t::visited() const
+   {
+      return pimpl_->visited.size();
+   }
+}
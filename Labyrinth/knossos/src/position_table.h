@@ -0,0 +1,347 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace knossos
+{
+   /// Упаковывает координаты в 64-битный ключ
+   inline std::uint64_t pack_position(position_t const & pos)
+   {
+      return (std::uint64_t(std::uint32_t(pos.x)) << 32) | std::uint32_t(pos.y);
+   }
+
+   inline position_t unpack_position(std::uint64_t key)
+   {
+      return position_t(int(std::uint32_t(key >> 32)), int(std::uint32_t(key)));
+   }
+
+   /// Код Мортона: биты x и y (со сдвигом в беззнаковый диапазон) вперемешку,
+   /// близкие на плоскости точки получают близкие коды
+   inline std::uint64_t morton_code(position_t const & pos)
+   {
+      auto spread = [](std::uint64_t v)
+      {
+         v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+         v = (v | (v << 8))  & 0x00ff00ff00ff00ffULL;
+         v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+         v = (v | (v << 2))  & 0x3333333333333333ULL;
+         v = (v | (v << 1))  & 0x5555555555555555ULL;
+         return v;
+      };
+      return spread(std::uint32_t(pos.x) ^ 0x80000000u)
+         | (spread(std::uint32_t(pos.y) ^ 0x80000000u) << 1);
+   }
+
+   namespace table_detail
+   {
+      template <class Value>
+      struct values_t
+      {
+         void reset(std::size_t size)
+         {
+            data.assign(size, Value());
+         }
+
+         void move(values_t & from, std::size_t from_slot, std::size_t to_slot)
+         {
+            data[to_slot] = std::move(from.data[from_slot]);
+         }
+
+         void swap(values_t & other)
+         {
+            data.swap(other.data);
+         }
+
+         template <class Writer>
+         void save(Writer & out) const
+         {
+            out.array(data);
+         }
+
+         template <class Reader>
+         bool load(Reader & in, std::size_t capacity)
+         {
+            in.array(data);
+            return data.size() == capacity;
+         }
+
+         std::vector<Value> data;
+      };
+
+      template <>
+      struct values_t<void>
+      {
+         void reset(std::size_t) {}
+         void move(values_t &, std::size_t, std::size_t) {}
+         void swap(values_t &) {}
+
+         template <class Writer>
+         void save(Writer &) const {}
+
+         template <class Reader>
+         bool load(Reader &, std::size_t) { return true; }
+      };
+   }
+
+   /*!
+    * \brief Хеш-таблица с открытой адресацией по упакованным координатам
+    *
+    * Линейное пробирование, на каждую ячейку приходится байт управления:
+    * пусто, удалено, либо старшие биты хеша ключа. При Value = void
+    * таблица работает как множество и значений не хранит.
+    */
+   template <class Value = void>
+   class position_table_t
+   {
+   public:
+      static std::size_t const npos = std::size_t(-1);
+
+      std::size_t size() const
+      {
+         return size_;
+      }
+
+      std::size_t capacity() const
+      {
+         return keys_.size();
+      }
+
+      bool occupied(std::size_t slot) const
+      {
+         return ctrl_[slot] >= full_tag;
+      }
+
+      position_t position(std::size_t slot) const
+      {
+         return unpack_position(keys_[slot]);
+      }
+
+      template <class V = Value>
+      V & value(std::size_t slot)
+      {
+         return values_.data[slot];
+      }
+
+      template <class V = Value>
+      V const & value(std::size_t slot) const
+      {
+         return values_.data[slot];
+      }
+
+      /// Номер ячейки с ключом pos либо npos
+      std::size_t find(position_t const & pos) const
+      {
+         if (keys_.empty())
+            return npos;
+
+         auto const key  = pack_position(pos);
+         auto const hash = mix(key);
+         auto const tag  = tag_of(hash);
+         auto const mask = keys_.size() - 1;
+
+         for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask)
+         {
+            auto const ctrl = ctrl_[slot];
+            if (ctrl == empty_tag)
+               return npos;
+            if (ctrl == tag && keys_[slot] == key)
+               return slot;
+         }
+      }
+
+      /// Возвращает номер ячейки и признак того, что ключ добавлен
+      std::pair<std::size_t, bool> insert(position_t const & pos)
+      {
+         if ((size_ + deleted_ + 1) * 4 > keys_.size() * 3)
+            rehash((size_ + 1) * 2);
+
+         auto const key  = pack_position(pos);
+         auto const hash = mix(key);
+         auto const tag  = tag_of(hash);
+         auto const mask = keys_.size() - 1;
+
+         std::size_t free_slot = npos;
+         std::size_t slot = hash & mask;
+         for (;; slot = (slot + 1) & mask)
+         {
+            auto const ctrl = ctrl_[slot];
+            if (ctrl == empty_tag)
+               break;
+            if (ctrl == deleted_tag)
+            {
+               if (free_slot == npos)
+                  free_slot = slot;
+            }
+            else if (ctrl == tag && keys_[slot] == key)
+               return std::make_pair(slot, false);
+         }
+
+         if (free_slot != npos)
+         {
+            slot = free_slot;
+            --deleted_;
+         }
+         ctrl_[slot] = tag;
+         keys_[slot] = key;
+         ++size_;
+         return std::make_pair(slot, true);
+      }
+
+      bool erase(position_t const & pos)
+      {
+         auto slot = find(pos);
+         if (slot == npos)
+            return false;
+
+         erase_slot(slot);
+         return true;
+      }
+
+      void erase_slot(std::size_t slot)
+      {
+         ctrl_[slot] = deleted_tag;
+         --size_;
+         ++deleted_;
+      }
+
+      /// Резервирует место под count ключей без перехеширования
+      void reserve(std::size_t count)
+      {
+         if (count * 4 > keys_.size() * 3)
+            rehash(count);
+      }
+
+      /// Удаляет все ключи, сохраняя выделенную память
+      void reset()
+      {
+         std::fill(ctrl_.begin(), ctrl_.end(), std::uint8_t(empty_tag));
+         size_ = deleted_ = 0;
+      }
+
+      /*!
+       * \brief То же за время, пропорциональное числу ключей, а не ёмкости
+       * \param slots ячейки всех ключей таблицы (после их добавления
+       *              таблица не перестраивалась и ключи не удалялись)
+       */
+      void reset(std::vector<std::size_t> const & slots)
+      {
+         for (auto slot : slots)
+            ctrl_[slot] = empty_tag;
+         size_ = deleted_ = 0;
+      }
+
+      void clear()
+      {
+         keys_.clear();
+         ctrl_.clear();
+         values_.reset(0);
+         size_ = deleted_ = 0;
+      }
+
+      /// Запись таблицы как есть, вместе с раскладкой по ячейкам
+      template <class Writer>
+      void save(Writer & out) const
+      {
+         out.array(keys_);
+         out.array(ctrl_);
+         values_.save(out);
+         out.value(std::uint64_t(size_));
+         out.value(std::uint64_t(deleted_));
+      }
+
+      /*!
+       * Чтение того, что записал save(), без перестроения (хеш ключей
+       * от процесса не зависит). Возвращает false, если размеры
+       * не согласованы; таблица тогда остаётся непригодной
+       */
+      template <class Reader>
+      bool load(Reader & in)
+      {
+         std::uint64_t size, deleted;
+         in.array(keys_);
+         in.array(ctrl_);
+         auto const loaded = values_.load(in, keys_.size());
+         in.value(size);
+         in.value(deleted);
+         size_    = std::size_t(size);
+         deleted_ = std::size_t(deleted);
+
+         auto const capacity = keys_.size();
+         return loaded && ctrl_.size() == capacity
+            && (capacity & (capacity - 1)) == 0
+            && (size_ + deleted_) * 4 <= capacity * 3;
+      }
+
+   private:
+      enum : std::uint8_t
+      {
+         empty_tag   = 0,
+         deleted_tag = 1,
+         full_tag    = 0x80
+      };
+
+      static std::uint64_t mix(std::uint64_t key)
+      {
+         key ^= key >> 33;
+         key *= 0xff51afd7ed558ccdULL;
+         key ^= key >> 33;
+         key *= 0xc4ceb9fe1a85ec53ULL;
+         key ^= key >> 33;
+         return key;
+      }
+
+      static std::uint8_t tag_of(std::uint64_t hash)
+      {
+         return std::uint8_t(full_tag | (hash >> 57));
+      }
+
+      void rehash(std::size_t count)
+      {
+         std::size_t capacity = 16;
+         while (capacity * 3 < count * 4 + 4)
+            capacity *= 2;
+
+         std::vector<std::uint64_t> keys(capacity);
+         std::vector<std::uint8_t>  ctrl(capacity, std::uint8_t(empty_tag));
+         table_detail::values_t<Value> values;
+         values.reset(capacity);
+
+         auto const mask = capacity - 1;
+         for (std::size_t from = 0; from != keys_.size(); ++from)
+         {
+            if (!occupied(from))
+               continue;
+
+            auto const hash = mix(keys_[from]);
+            auto to = hash & mask;
+            while (ctrl[to] != empty_tag)
+               to = (to + 1) & mask;
+
+            ctrl[to] = tag_of(hash);
+            keys[to] = keys_[from];
+            values.move(values_, from, to);
+         }
+
+         keys_.swap(keys);
+         ctrl_.swap(ctrl);
+         values_.swap(values);
+         deleted_ = 0;
+      }
+
+   private:
+      std::vector<std::uint64_t>    keys_;
+      std::vector<std::uint8_t>     ctrl_;
+      table_detail::values_t<Value> values_;
+      std::size_t size_    = 0;
+      std::size_t deleted_ = 0;
+   };
+
+   template <class Value>
+   std::size_t const position_table_t<Value>::npos;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "storage.h"
+#include "position_table.h"
+
+#include <boost/optional.hpp>
+
+#include <vector>
+
+
+namespace knossos
+{
+   typedef std::uint32_t section_id_t;
+
+   /// Нумерация секций снимка подряд, номер - строка таблицы переходов
+   struct section_index_t
+   {
+      explicit section_index_t(storage_t const & storage)
+      {
+         positions.reserve(storage.size());
+         ids.reserve(storage.size());
+         for (auto const & pos : storage.positions())
+         {
+            ids.value(ids.insert(pos).first) = section_id_t(positions.size());
+            positions.push_back(pos);
+         }
+      }
+
+      boost::optional<section_id_t> id(position_t const & pos) const
+      {
+         auto slot = ids.find(pos);
+         if (slot == position_table_t<section_id_t>::npos)
+            return boost::none;
+         return ids.value(slot);
+      }
+
+      std::vector<position_t>        positions;
+      position_table_t<section_id_t> ids;
+   };
+}
@@ -0,0 +1,156 @@
+#include <knossos/snapshot.h>
+
+#include "navigation.h"
+#include "corridors.h"
+#include "thread_pool.h"
+
+using boost::optional;
+
+namespace knossos
+{
+   snapshot_t::snapshot_t()
+      : storage_(make_storage(storage_tree))
+      , version_(0)
+   {}
+
+   snapshot_t::snapshot_t(std::shared_ptr<storage_t const> storage, std::uint64_t version)
+      : storage_(std::move(storage))
+      , version_(version)
+   {}
+
+   std::uint64_t snapshot_t::version() const
+   {
+      return version_;
+   }
+
+   std::size_t snapshot_t::size() const
+   {
+      return storage_->size();
+   }
+
+   positions_range_t snapshot_t::sections() const
+   {
+      return storage_->positions();
+   }
+
+   void snapshot_t::sections_in(region_t const & region, std::vector<position_t> & out) const
+   {
+      storage_->corridors().sections(region, out);
+   }
+
+   std::uint64_t snapshot_t::count_in(region_t const & region) const
+   {
+      return storage_->corridors().count(region);
+   }
+
+   void snapshot_t::sections_within(position_t const & center, std::uint32_t radius,
+                                    std::vector<position_t> & out) const
+   {
+      storage_->corridors().sections(center, radius, out);
+   }
+
+   std::uint64_t snapshot_t::count_within(position_t const & center, std::uint32_t radius) const
+   {
+      return storage_->corridors().count(center, radius);
+   }
+
+   bool snapshot_t::contains(position_t const & position) const
+   {
+      count(counters.lookups, 1);
+      return storage_->find(position).is_initialized();
+   }
+
+   void snapshot_t::navigate_batch(std::vector<route_query_t> const & queries,
+                                   std::vector<optional<position_t>> & results,
+                                   unsigned num_threads) const
+   {
+      results.assign(queries.size(), boost::none);
+      count(counters.lookups, queries.size());
+
+      auto const & storage = *storage_;
+      parallel_for_stealing(queries.size(), num_threads, 16,
+         [&](std::size_t begin, std::size_t end)
+         {
+            for (auto i = begin; i != end; ++i)
+            {
+               auto const & query = queries[i];
+               if (auto start = storage.find(query.start))
+               {
+                  auto finish = storage.walk(*start, query.route, query.route + query.length);
+                  results[i] = storage.position(finish);
+               }
+            }
+         });
+   }
+
+   ////////////////////////////////////////////////////////////////////////////
+
+   cursor_t::cursor_t(snapshot_t const & map, optional<position_t> const & start_pos)
+      : map_(map)
+   {
+      if (start_pos && !set_position(*start_pos))
+         throw incorrect_position_error_t();
+   }
+
+   snapshot_t const & cursor_t::map() const
+   {
+      return map_;
+   }
+
+   bool cursor_t::is_position_set() const
+   {
+      return current_.is_initialized();
+   }
+
+   bool cursor_t::set_position(position_t const & position)
+   {
+      return navigation_t{*map_.storage_, current_, current_pos_}.set_position(position);
+   }
+
+   position_t const & cursor_t::position() const
+   {
+      if (!current_)
+         throw position_not_set_error_t();
+
+      return current_pos_;
+   }
+
+   position_t const & cursor_t::navigate(directions_range_t route,
+                                         optional<position_t> const & start_pos)
+   {
+      navigation_t nav{*map_.storage_, current_, current_pos_};
+      return nav.finish(nav.storage.walk(nav.start(start_pos), route));
+   }
+
+   position_t const & cursor_t::navigate(direction_t const * first, direction_t const * last,
+                                         optional<position_t> const & start_pos)
+   {
+      navigation_t nav{*map_.storage_, current_, current_pos_};
+      return nav.finish(nav.storage.walk(nav.start(start_pos), first, last));
+   }
+
+   position_t const & cursor_t::navigate(std::uint8_t const * route, std::size_t length,
+                                         optional<position_t> const & start_pos)
+   {
+      check_direction_codes(route, length);
+
+      navigation_t nav{*map_.storage_, current_, current_pos_};
+      return nav.finish(nav.storage.walk(nav.start(start_pos), route, route + length));
+   }
+
+   position_t const & cursor_t::navigate(direction_t const * first, direction_t const * last,
+                                         route_trace_t & trace,
+                                         optional<position_t> const & start_pos)
+   {
+      return navigation_t{*map_.storage_, current_, current_pos_}.trace(first, last, trace, start_pos);
+   }
+
+   position_t const & cursor_t::navigate(route_run_t const * first, route_run_t const * last,
+                                         optional<position_t> const & start_pos)
+   {
+      check_route_runs(first, last);
+
+      navigation_t nav{*map_.storage_, current_, current_pos_};
+      return nav.finish(nav.storage.walk_runs(nav.start(start_pos), first, last));
+   }
+}
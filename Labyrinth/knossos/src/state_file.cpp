@@ -0,0 +1,117 @@
+#include "state_file.h"
+#include "storage.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace bip = boost::interprocess;
+
+namespace knossos
+{
+   namespace
+   {
+      char const          state_magic[8]   = {'K', 'N', 'O', 'S', 'S', 'O', 'S', 'S'};
+      std::uint32_t const state_byte_order = 0x01020304;
+
+      /// Увеличивается при любом изменении формата, в том числе
+      /// содержимого, которое пишут хранилища
+      std::uint32_t const state_version = 1;
+
+      /*!
+       * Заголовок файла состояния. Его проверка не зависит от размера
+       * файла; содержимое за ним проверяется контрольной суммой до того,
+       * как хранилище начнёт его читать.
+       */
+      struct state_header_t
+      {
+         char          magic[8];
+         std::uint32_t byte_order;
+         std::uint32_t version;
+         std::uint32_t storage;
+         std::uint32_t has_position;
+         std::int32_t  x, y;
+         std::uint64_t payload_size;   ///< байт содержимого за заголовком
+         std::uint64_t checksum;       ///< state_checksum_t содержимого
+      };
+
+      static_assert(sizeof(state_header_t) == 48, "state header must not have padding");
+   }
+
+   void save_state(std::string const & path, storage_type_t type, storage_t const & storage,
+                   boost::optional<position_t> const & position)
+   {
+      std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+
+      state_header_t header = {};
+      std::memcpy(header.magic, state_magic, sizeof(state_magic));
+      header.byte_order   = state_byte_order;
+      header.version      = state_version;
+      header.storage      = std::uint32_t(type);
+      header.has_position = position.is_initialized();
+      header.x            = position ? position->x : 0;
+      header.y            = position ? position->y : 0;
+
+      // Размер и сумма известны только в конце, заголовок дописывается после
+      file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+      state_writer_t writer(file);
+      storage.save(writer);
+
+      header.payload_size = writer.size();
+      header.checksum     = writer.checksum();
+      file.seekp(0);
+      file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+      file.close();
+      if (!file)
+         throw state_io_error_t();
+   }
+
+   labyrinth_state_t load_state(std::string const & path)
+   {
+      bip::mapped_region region;
+      try
+      {
+         bip::file_mapping file(path.c_str(), bip::read_only);
+         bip::mapped_region(file, bip::read_only).swap(region);
+      }
+      catch (bip::interprocess_exception const &)
+      {
+         // В том числе пустой файл, который нельзя отобразить
+         throw state_io_error_t();
+      }
+
+      auto const size = region.get_size();
+      auto const data = static_cast<char const *>(region.get_address());
+
+      state_header_t header;
+      if (size < sizeof(header))
+         throw state_format_error_t();
+      std::memcpy(&header, data, sizeof(header));
+      if (std::memcmp(header.magic, state_magic, sizeof(state_magic)) != 0
+          || header.byte_order != state_byte_order
+          || header.version != state_version
+          || header.storage > storage_versioned)
+         throw state_format_error_t();
+      if (header.payload_size != size - sizeof(header))
+         throw state_corrupt_error_t();
+
+      region.advise(bip::mapped_region::advice_sequential);
+      state_checksum_t checksum;
+      checksum.update(data + sizeof(header), std::size_t(header.payload_size));
+      if (checksum.value() != header.checksum)
+         throw state_corrupt_error_t();
+
+      labyrinth_state_t state;
+      state.type    = storage_type_t(header.storage);
+      state.storage = make_storage(state.type);
+
+      state_reader_t reader(data + sizeof(header), std::size_t(header.payload_size));
+      state.storage->load(reader);
+      if (!reader.done())
+         throw state_corrupt_error_t();
+
+      if (header.has_position)
+         state.position = position_t(header.x, header.y);
+      return state;
+   }
+}
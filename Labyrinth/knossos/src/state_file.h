@@ -0,0 +1,196 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include "exceptions.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+namespace knossos
+{
+   struct storage_t;
+
+   /*!
+    * \brief Контрольная сумма содержимого файла состояния
+    *
+    * Слова по 8 байт перемешиваются умножением в четырёх независимых
+    * цепочках, чтобы умножения шли параллельно. Данные дополняются нулями
+    * до целого числа слов (так же они и лежат в файле).
+    */
+   class state_checksum_t
+   {
+   public:
+      void update(void const * data, std::size_t size)
+      {
+         auto const * bytes = static_cast<char const *>(data);
+         for (; size >= 8; bytes += 8, size -= 8)
+         {
+            std::uint64_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            add(word);
+         }
+         if (size != 0)
+         {
+            std::uint64_t word = 0;
+            std::memcpy(&word, bytes, size);
+            add(word);
+         }
+      }
+
+      std::uint64_t value() const
+      {
+         auto result = std::uint64_t(count_);
+         for (auto lane : lanes_)
+            result = (result ^ lane ^ (lane >> 31)) * multiplier;
+         return result;
+      }
+
+   private:
+      static std::uint64_t const multiplier = 0x9e3779b97f4a7c15ULL;
+
+      void add(std::uint64_t word)
+      {
+         auto & lane = lanes_[count_++ & 3];
+         lane = (lane ^ word ^ (lane >> 29)) * multiplier;
+      }
+
+      std::uint64_t lanes_[4] = {1, 2, 3, 4};
+      std::uint64_t count_ = 0;
+   };
+
+   /*!
+    * \brief Запись состояния хранилища в файл
+    *
+    * Значения и массивы пишутся как есть, каждая запись дополняется
+    * нулями до границы 8 байт. Массив предваряется числом элементов.
+    */
+   class state_writer_t
+   {
+   public:
+      explicit state_writer_t(std::ofstream & file)
+         : file_(file)
+      {}
+
+      template <class T>
+      void value(T const & value)
+      {
+         write(&value, sizeof(T));
+      }
+
+      template <class T>
+      void array(std::vector<T> const & values)
+      {
+         static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+         value(std::uint64_t(values.size()));
+         write(values.data(), values.size() * sizeof(T));
+      }
+
+      std::uint64_t size() const
+      {
+         return size_;
+      }
+
+      std::uint64_t checksum() const
+      {
+         return checksum_.value();
+      }
+
+   private:
+      void write(void const * data, std::size_t size)
+      {
+         // Пустой массив: data() пустого вектора может быть нулевым
+         if (size == 0)
+            return;
+
+         static char const zeros[8] = {};
+         auto const padding = (8 - size % 8) % 8;
+
+         file_.write(static_cast<char const *>(data), std::streamsize(size));
+         file_.write(zeros, std::streamsize(padding));
+         checksum_.update(data, size);
+         size_ += size + padding;
+      }
+
+      std::ofstream &  file_;
+      state_checksum_t checksum_;
+      std::uint64_t    size_ = 0;
+   };
+
+   /*!
+    * \brief Чтение состояния, записанного state_writer_t, из памяти
+    *
+    * Каждое чтение проверяет, что запись целиком лежит в данных,
+    * иначе кидает state_corrupt_error_t
+    */
+   class state_reader_t
+   {
+   public:
+      state_reader_t(char const * data, std::size_t size)
+         : pos_(data)
+         , end_(data + size)
+      {}
+
+      template <class T>
+      void value(T & value)
+      {
+         read(&value, sizeof(T));
+      }
+
+      template <class T>
+      void array(std::vector<T> & values)
+      {
+         static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+         std::uint64_t count;
+         value(count);
+         if (count > std::uint64_t(end_ - pos_) / sizeof(T))
+            throw state_corrupt_error_t();
+
+         values.resize(std::size_t(count));
+         read(values.data(), values.size() * sizeof(T));
+      }
+
+      /// Прочитаны ли все данные
+      bool done() const
+      {
+         return pos_ == end_;
+      }
+
+   private:
+      void read(void * data, std::size_t size)
+      {
+         if (size == 0)
+            return;
+
+         auto const padded = size + (8 - size % 8) % 8;
+         if (padded > std::size_t(end_ - pos_))
+            throw state_corrupt_error_t();
+
+         std::memcpy(data, pos_, size);
+         pos_ += padded;
+      }
+
+      char const * pos_;
+      char const * end_;
+   };
+
+   /// Содержимое файла состояния лабиринта
+   struct labyrinth_state_t
+   {
+      storage_type_t             type;
+      std::unique_ptr<storage_t> storage;
+      boost::optional<position_t> position;
+   };
+
+   /// Сохраняет хранилище и текущее положение в файл path
+   void save_state(std::string const & path, storage_type_t type, storage_t const & storage,
+                   boost::optional<position_t> const & position);
+
+   /// Читает файл, записанный save_state()
+   labyrinth_state_t load_state(std::string const & path);
+}
@@ -0,0 +1,49 @@
+#include "stats.h"
+
+
+namespace knossos
+{
+   counters_t counters;
+
+   char const * phase_name(phase_t phase)
+   {
+      switch (phase)
+      {
+      case phase_build:    return "build";
+      case phase_remove:   return "remove";
+      case phase_optimize: return "optimize";
+      case phase_index:    return "index";
+      case phase_navigate: return "navigate";
+      case phase_save:     return "save";
+      case phase_load:     return "load";
+      default:             return "unknown";
+      }
+   }
+
+   stats_t stats()
+   {
+      stats_t result;
+      result.enabled            = stats_enabled;
+      result.sections_inserted  = counters.sections_inserted.load();
+      result.duplicates_skipped = counters.duplicates_skipped.load();
+      result.sections_removed   = counters.sections_removed.load();
+      result.lookups            = counters.lookups.load();
+      result.steps_taken        = counters.steps_taken.load();
+      result.steps_blocked      = counters.steps_blocked.load();
+      for (int phase = 0; phase != phase_num; ++phase)
+         result.seconds[phase] = counters.nanoseconds[phase].load() * 1e-9;
+      return result;
+   }
+
+   void reset_stats()
+   {
+      counters.sections_inserted  = 0;
+      counters.duplicates_skipped = 0;
+      counters.sections_removed   = 0;
+      counters.lookups            = 0;
+      counters.steps_taken        = 0;
+      counters.steps_blocked      = 0;
+      for (auto & nanoseconds : counters.nanoseconds)
+         nanoseconds = 0;
+   }
+}
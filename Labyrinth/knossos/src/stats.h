@@ -0,0 +1,80 @@
+#pragma once
+
+#include <knossos/stats.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+namespace knossos
+{
+   /// Учёт включён опцией WITH_STATS. Код под if (stats_enabled)
+   /// без неё выбрасывается компилятором вместе с вычислением аргументов
+#ifdef KNOSSOS_STATS
+   bool const stats_enabled = true;
+#else
+   bool const stats_enabled = false;
+#endif
+
+   typedef std::atomic<std::uint64_t> counter_t;
+
+   /// Счётчики процесса, см. stats_t
+   struct counters_t
+   {
+      counter_t sections_inserted;
+      counter_t duplicates_skipped;
+      counter_t sections_removed;
+      counter_t lookups;
+      counter_t steps_taken;
+      counter_t steps_blocked;
+      counter_t nanoseconds[phase_num];
+   };
+
+   extern counters_t counters;
+
+   /// Увеличивает счётчик, каждый вызов - одно атомарное сложение
+   inline void count(counter_t & counter, std::uint64_t value)
+   {
+      if (stats_enabled)
+         counter.fetch_add(value, std::memory_order_relaxed);
+   }
+
+   /// Учёт шагов одного прохода маршрута
+   inline void count_steps(std::uint64_t steps, std::uint64_t blocked)
+   {
+      count(counters.steps_taken, steps - blocked);
+      count(counters.steps_blocked, blocked);
+   }
+
+   /// Добавляет ко времени этапа время жизни объекта
+   class phase_timer_t
+   {
+   public:
+      explicit phase_timer_t(phase_t phase)
+         : phase_(phase)
+      {
+         if (stats_enabled)
+            start_ = clock_t::now();
+      }
+
+      ~phase_timer_t()
+      {
+         if (stats_enabled)
+         {
+            auto const elapsed = clock_t::now() - start_;
+            count(counters.nanoseconds[phase_], std::uint64_t(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+         }
+      }
+
+      phase_timer_t(phase_timer_t const &) = delete;
+      phase_timer_t & operator=(phase_timer_t const &) = delete;
+
+   private:
+      typedef std::chrono::steady_clock clock_t;
+
+      phase_t const      phase_;
+      clock_t::time_point start_;
+   };
+}
@@ -0,0 +1,67 @@
+#include "storage.h"
+#include "corridors.h"
+#include "state_file.h"
+
+#include <stdexcept>
+
+
+namespace knossos
+{
+   std::unique_ptr<storage_t> make_storage(storage_type_t type)
+   {
+      switch (type)
+      {
+      case storage_tree:      return make_tree_storage();
+      case storage_hash:      return make_hash_storage();
+      case storage_bitmap:    return make_bitmap_storage();
+      case storage_compact:   return make_compact_storage();
+      case storage_versioned: return make_versioned_storage();
+      }
+      throw std::invalid_argument("unknown storage type");
+   }
+
+   void storage_t::save(state_writer_t & out) const
+   {
+      auto const range = positions();
+      out.array(std::vector<position_t>(range.begin(), range.end()));
+   }
+
+   void storage_t::load(state_reader_t & in)
+   {
+      std::vector<position_t> sections;
+      in.array(sections);
+      insert_bulk(sections, 0);
+   }
+
+   storage_t::handle_t storage_t::walk_runs(handle_t handle, route_run_t const * first,
+                                            route_run_t const * last) const
+   {
+      // Все секции внутри коридора существуют, поэтому дескриптор
+      // нужен только для конечной точки
+      auto const & index = corridors();
+      phase_timer_t timer(phase_navigate);
+      return *find(index.walk(position(handle), first, last));
+   }
+
+   void storage_t::reset_corridors()
+   {
+      std::atomic_store(&corridors_, std::shared_ptr<corridors_t const>());
+   }
+
+   corridors_t const & storage_t::corridors() const
+   {
+      auto index = std::atomic_load(&corridors_);
+      if (!index)
+      {
+         std::lock_guard<std::mutex> guard(corridors_lock_);
+         index = std::atomic_load(&corridors_);
+         if (!index)
+         {
+            phase_timer_t timer(phase_index);
+            index = std::make_shared<corridors_t const>(*this);
+            std::atomic_store(&corridors_, index);
+         }
+      }
+      return *index;
+   }
+}
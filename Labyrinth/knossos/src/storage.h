@@ -0,0 +1,214 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include "tracer.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace knossos
+{
+   class corridors_t;
+   class state_writer_t;
+   class state_reader_t;
+
+   /*!
+    * \brief Внутренний интерфейс хранилища секций
+    *
+    * Каждая реализация (дерево, хеш-таблица, ...) сама решает, как хранить
+    * секции и как находить соседей. Секция внутри хранилища адресуется
+    * дескриптором handle_t, смысл которого определяется реализацией
+    * (указатель, номер ячейки, упакованные координаты). Дескрипторы
+    * остаются действительными только до следующего изменения хранилища.
+    */
+   struct storage_t
+   {
+      typedef std::uint64_t handle_t;
+
+      storage_t() {}
+
+      /// Копия строит свой индекс коридоров заново
+      storage_t(storage_t const &) {}
+      storage_t & operator=(storage_t const &) = delete;
+
+      virtual ~storage_t() {}
+
+      /// Независимая копия хранилища
+      virtual std::unique_ptr<storage_t> clone() const = 0;
+
+      /// Добавляет секцию, возвращает false если она уже существует
+      virtual bool insert(position_t const & pos) = 0;
+
+      /*!
+       * \brief Пакетное добавление
+       * \param sections координаты, реализация может их переупорядочить
+       * \param num_threads сколько потоков можно занять (0 - все ядра)
+       */
+      virtual void insert_bulk(std::vector<position_t> & sections, unsigned num_threads)
+      {
+         (void)num_threads;
+         for (auto const & pos : sections)
+            insert(pos);
+      }
+
+      /// Готовит место под count секций всего, если реализация это умеет
+      virtual void reserve(std::size_t count)
+      {
+         (void)count;
+      }
+
+      /// Удаляет секцию, возвращает false если её не было
+      virtual bool erase(position_t const & pos) = 0;
+
+      virtual std::size_t size() const = 0;
+
+      virtual positions_range_t positions() const = 0;
+
+      virtual boost::optional<handle_t> find(position_t const & pos) const = 0;
+
+      virtual position_t position(handle_t handle) const = 0;
+
+      /// Проходит маршрут, возвращает дескриптор конечной секции
+      virtual handle_t walk(handle_t handle, directions_range_t route) const = 0;
+      virtual handle_t walk(handle_t handle, direction_t const * first,
+                            direction_t const * last) const = 0;
+      virtual handle_t walk(handle_t handle, std::uint8_t const * first,
+                            std::uint8_t const * last) const = 0;
+
+      /// То же с записью пройденного пути и шагов в стену
+      virtual handle_t walk(handle_t handle, direction_t const * first,
+                            direction_t const * last, route_trace_t & trace) const = 0;
+
+      /// Соседняя секция в направлении dir либо handle, если там стена.
+      /// В отличие от walk() не учитывается в статистике навигации
+      virtual handle_t neighbour(handle_t handle, direction_t dir) const = 0;
+
+      /// Перестраивает хранилище для более быстрого обхода
+      virtual void optimize() {}
+
+      /*!
+       * \brief Запись содержимого в файл состояния (см. labyrinth_t::save)
+       *
+       * По умолчанию пишутся только координаты секций, и load() связывает
+       * их заново пакетным добавлением. Хранилища, внутреннее представление
+       * которых не зависит от адресов в памяти, пишут его целиком и читают
+       * без перестроения.
+       */
+      virtual void save(state_writer_t & out) const;
+
+      /// Чтение в пустое хранилище того, что записал save()
+      virtual void load(state_reader_t & in);
+
+      /*!
+       * \brief Проходит маршрут из участков по индексу коридоров
+       *
+       * Индекс строится при первом вызове (из любого потока, один раз)
+       * и живёт до reset_corridors()
+       */
+      handle_t walk_runs(handle_t handle, route_run_t const * first,
+                         route_run_t const * last) const;
+
+      /// Сбрасывает индекс коридоров, вызывается перед изменением хранилища
+      void reset_corridors();
+
+      /// Индекс коридоров, строится как в walk_runs
+      corridors_t const & corridors() const;
+
+   private:
+      mutable std::mutex                         corridors_lock_;
+      mutable std::shared_ptr<corridors_t const> corridors_;
+   };
+
+   /*!
+    * \brief Общая часть реализаций хранилища
+    *
+    * Цикл по маршруту вынесен сюда, чтобы виртуальным был только вызов
+    * walk(), а шаг Derived::step() встраивался в цикл. Во время обхода
+    * реализация может держать более удобный, чем дескриптор, курсор
+    * Derived::cursor_t (например, вместе с уже найденным блоком).
+    */
+   template <class Derived>
+   struct storage_base_t : storage_t
+   {
+      handle_t walk(handle_t handle, directions_range_t route) const override
+      {
+         return walk_range(handle, route.begin(), route.end());
+      }
+
+      handle_t walk(handle_t handle, direction_t const * first,
+                    direction_t const * last) const override
+      {
+         return walk_range(handle, first, last);
+      }
+
+      handle_t walk(handle_t handle, std::uint8_t const * first,
+                    std::uint8_t const * last) const override
+      {
+         return walk_range(handle, first, last);
+      }
+
+      handle_t walk(handle_t handle, direction_t const * first,
+                    direction_t const * last, route_trace_t & trace) const override
+      {
+         // Шаг в стену не меняет курсора, а значит и дескриптора
+         phase_timer_t timer(phase_navigate);
+         auto const & self = static_cast<Derived const &>(*this);
+         auto cursor = self.cursor(handle);
+         trace_route(first, last, position(handle), trace, [&](direction_t dir)
+         {
+            auto const before = self.handle(cursor);
+            self.step(cursor, dir);
+            return self.handle(cursor) != before;
+         });
+         count_steps(std::uint64_t(last - first), trace.blocked);
+         return self.handle(cursor);
+      }
+
+      handle_t neighbour(handle_t handle, direction_t dir) const override
+      {
+         auto const & self = static_cast<Derived const &>(*this);
+         auto cursor = self.cursor(handle);
+         self.step(cursor, dir);
+         return self.handle(cursor);
+      }
+
+   private:
+      template <class Iterator>
+      handle_t walk_range(handle_t handle, Iterator first, Iterator last) const
+      {
+         phase_timer_t timer(phase_navigate);
+         auto const & self = static_cast<Derived const &>(*this);
+         auto cursor = self.cursor(handle);
+         if (!stats_enabled)
+         {
+            for (; first != last; ++first)
+               self.step(cursor, direction_t(*first));
+            return self.handle(cursor);
+         }
+
+         // Шаг в стену узнаётся так же, как в walk() с записью пути
+         std::uint64_t steps = 0, blocked = 0;
+         for (; first != last; ++first, ++steps)
+         {
+            auto const before = self.handle(cursor);
+            self.step(cursor, direction_t(*first));
+            blocked += self.handle(cursor) == before;
+         }
+         count_steps(steps, blocked);
+         return self.handle(cursor);
+      }
+   };
+
+   std::unique_ptr<storage_t> make_tree_storage();
+   std::unique_ptr<storage_t> make_hash_storage();
+   std::unique_ptr<storage_t> make_bitmap_storage();
+   std::unique_ptr<storage_t> make_compact_storage();
+   std::unique_ptr<storage_t> make_versioned_storage();
+
+   std::unique_ptr<storage_t> make_storage(storage_type_t type);
+}
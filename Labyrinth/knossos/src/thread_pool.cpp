@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+
+
+namespace knossos
+{
+   thread_pool_t::thread_pool_t(unsigned num_threads)
+   {
+      for (unsigned worker = 1; worker <= num_threads; ++worker)
+         threads_.emplace_back(&thread_pool_t::worker_loop, this, worker);
+   }
+
+   thread_pool_t::~thread_pool_t()
+   {
+      {
+         std::lock_guard<std::mutex> guard(mutex_);
+         stop_ = true;
+      }
+      wake_.notify_all();
+      for (auto & thread : threads_)
+         thread.join();
+   }
+
+   unsigned thread_pool_t::size() const
+   {
+      return unsigned(threads_.size()) + 1;
+   }
+
+   void thread_pool_t::run(unsigned workers, job_t const & job)
+   {
+      std::unique_lock<std::mutex> busy(busy_, std::try_to_lock);
+      if (!busy || workers <= 1)
+      {
+         job(0);
+         return;
+      }
+
+      {
+         std::lock_guard<std::mutex> guard(mutex_);
+         job_     = &job;
+         workers_ = std::min(workers, size());
+         pending_ = workers_ - 1;
+         error_   = nullptr;
+         ++generation_;
+      }
+      wake_.notify_all();
+
+      std::exception_ptr error;
+      try
+      {
+         job(0);
+      }
+      catch (...)
+      {
+         error = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return pending_ == 0; });
+      job_ = nullptr;
+
+      if (!error)
+         error = error_;
+      if (error)
+         std::rethrow_exception(error);
+   }
+
+   thread_pool_t & thread_pool_t::shared()
+   {
+      static thread_pool_t pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+      return pool;
+   }
+
+   void thread_pool_t::worker_loop(unsigned worker)
+   {
+      std::size_t seen = 0;
+      for (;;)
+      {
+         job_t const * job;
+         {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+               return;
+
+            seen = generation_;
+            if (worker >= workers_)
+               continue;
+            job = job_;
+         }
+
+         std::exception_ptr error;
+         try
+         {
+            (*job)(worker);
+         }
+         catch (...)
+         {
+            error = std::current_exception();
+         }
+
+         std::lock_guard<std::mutex> guard(mutex_);
+         if (error && !error_)
+            error_ = error;
+         if (--pending_ == 0)
+            done_.notify_one();
+      }
+   }
+}
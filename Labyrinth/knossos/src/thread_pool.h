@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Пул потоков, выполняющий одну параллельную задачу за раз
+    *
+    * Задача - функция job(worker), которую вызывают сразу несколько
+    * потоков пула, вызывающий поток выступает исполнителем номер 0.
+    * Распределение работы внутри задачи - забота самой задачи
+    * (см. parallel_for_stealing).
+    */
+   class thread_pool_t
+   {
+   public:
+      typedef std::function<void (unsigned)> job_t;
+
+      /// \param num_threads число фоновых потоков
+      explicit thread_pool_t(unsigned num_threads);
+      ~thread_pool_t();
+
+      thread_pool_t(thread_pool_t const &) = delete;
+      thread_pool_t & operator=(thread_pool_t const &) = delete;
+
+      /// Максимальное число исполнителей, включая вызывающий поток
+      unsigned size() const;
+
+      /*!
+       * \brief Выполняет job на workers исполнителях и ждёт завершения
+       *
+       * Если пул уже занят задачей из другого потока, job выполняется
+       * одним исполнителем в вызывающем потоке. Исключение, выброшенное
+       * любым исполнителем, пробрасывается наружу.
+       */
+      void run(unsigned workers, job_t const & job);
+
+      /// Общий пул на все ядра процессора
+      static thread_pool_t & shared();
+
+   private:
+      void worker_loop(unsigned worker);
+
+   private:
+      std::mutex busy_;
+
+      std::mutex              mutex_;
+      std::condition_variable wake_;
+      std::condition_variable done_;
+
+      job_t const *      job_        = nullptr;
+      unsigned           workers_    = 0;
+      unsigned           pending_    = 0;
+      std::size_t        generation_ = 0;
+      bool               stop_       = false;
+      std::exception_ptr error_;
+
+      std::vector<std::thread> threads_;
+   };
+
+   /*!
+    * \brief Параллельный цикл по [0, count) с перехватом работы
+    *
+    * Каждый исполнитель получает свой непрерывный отрезок индексов и
+    * берёт из его начала порции по grain элементов. Закончив свой
+    * отрезок, исполнитель забирает у другого вторую половину остатка
+    * (или весь остаток, если он меньше двух элементов).
+    * body(begin, end) вызывается для непересекающихся порций.
+    */
+   template <class Body>
+   void parallel_for_stealing(thread_pool_t & pool, std::size_t count, unsigned num_threads,
+                              std::size_t grain, Body const & body)
+   {
+      if (num_threads == 0 || num_threads > pool.size())
+         num_threads = pool.size();
+
+      auto const workers = unsigned(std::max<std::size_t>(1,
+         std::min<std::size_t>(num_threads, count / grain)));
+
+      struct range_t
+      {
+         std::mutex  lock;
+         std::size_t begin;
+         std::size_t end;
+      };
+      std::unique_ptr<range_t[]> ranges(new range_t[workers]);
+      for (unsigned worker = 0; worker != workers; ++worker)
+      {
+         ranges[worker].begin = count * worker / workers;
+         ranges[worker].end   = count * (worker + 1) / workers;
+      }
+
+      pool.run(workers, [&](unsigned worker)
+      {
+         auto & own = ranges[worker];
+         for (;;)
+         {
+            std::size_t begin, end;
+            {
+               std::lock_guard<std::mutex> guard(own.lock);
+               begin = own.begin;
+               end   = std::min(own.end, begin + grain);
+               own.begin = end;
+            }
+            if (begin < end)
+            {
+               body(begin, end);
+               continue;
+            }
+
+            // Свой отрезок исчерпан: половина остатка берётся у соседа.
+            // Пока свой отрезок пуст, его никто не трогает, поэтому
+            // блокировки жертвы и своего отрезка не пересекаются
+            bool stolen = false;
+            for (unsigned shift = 1; shift != workers && !stolen; ++shift)
+            {
+               auto & victim = ranges[(worker + shift) % workers];
+               {
+                  std::lock_guard<std::mutex> guard(victim.lock);
+                  if (victim.begin < victim.end)
+                  {
+                     begin = victim.begin + (victim.end - victim.begin) / 2;
+                     end   = victim.end;
+                     victim.end = begin;
+                     stolen = true;
+                  }
+               }
+            }
+            if (!stolen)
+               return;
+
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.begin = begin;
+            own.end   = end;
+         }
+      });
+   }
+
+   /// parallel_for_stealing на общем пуле потоков
+   template <class Body>
+   void parallel_for_stealing(std::size_t count, unsigned num_threads,
+                              std::size_t grain, Body const & body)
+   {
+      parallel_for_stealing(thread_pool_t::shared(), count, num_threads, grain, body);
+   }
+}
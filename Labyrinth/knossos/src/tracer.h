@@ -0,0 +1,75 @@
+#pragma once
+
+#include <knossos/labyrinth.h>
+
+#include <algorithm>
+#include <cstddef>
+
+
+namespace knossos
+{
+   /*!
+    * \brief Проход маршрута с записью пути в trace
+    * \param pos начальные координаты
+    * \param step шаг step(dir), возвращает false, если шаг был в стену
+    *
+    * Шаг записывается без ветвлений: текущий участок держится в локальных
+    * переменных и на каждом шаге сохраняется в свою ячейку вектора, а номер
+    * ячейки сдвигается, когда шаг начинает новый участок. Место под участки
+    * выделяется порциями, так что в цикле нет проверок ёмкости. Память
+    * вектора переиспользуется между вызовами.
+    */
+   template <class Step>
+   void trace_route(direction_t const * first, direction_t const * last,
+                    position_t pos, route_trace_t & trace, Step const & step)
+   {
+      static int const dx[total_num] = {0, -1, 0, 1};
+      static int const dy[total_num] = {1, 0, -1, 0};
+      std::size_t const portion = 4096;
+
+      auto & runs = trace.runs;
+      runs.clear();
+
+      // Поля текущего участка в отдельных переменных, выбор - по маске,
+      // чтобы компилятор не заводил ветвлений и не собирал запись в памяти
+      int start_x = pos.x, start_y = pos.y;
+      unsigned run_dir = total_num;
+      std::uint64_t run_count = 0;
+      std::size_t used = 0;   // ячейка текущего участка
+      std::uint64_t blocked = 0;
+
+      while (first != last)
+      {
+         auto const count = std::min<std::size_t>(last - first, portion);
+         runs.resize(used + count + 1);
+         auto * const out = runs.data();
+
+         for (auto const end = first + count; first != end; ++first)
+         {
+            auto const dir = *first;
+            unsigned const moved = step(dir);
+            unsigned const fresh = moved & unsigned(unsigned(dir) != run_dir);
+            used += fresh & unsigned(run_count != 0);
+
+            auto const keep = int(fresh) - 1;   // все единицы, если участок продолжается
+            start_x = (start_x & keep) | (pos.x & ~keep);
+            start_y = (start_y & keep) | (pos.y & ~keep);
+            run_dir = (run_dir & unsigned(keep)) | (unsigned(dir) & ~unsigned(keep));
+            run_count = ((run_count + moved) & std::uint64_t(std::int64_t(keep))) | fresh;
+
+            auto & record = out[used];
+            record.start.x = start_x;
+            record.start.y = start_y;
+            record.dir     = direction_t(run_dir);
+            record.count   = run_count;
+
+            pos.x += dx[dir] & -int(moved);
+            pos.y += dy[dir] & -int(moved);
+            blocked += 1 - moved;
+         }
+      }
+
+      runs.resize(used + (run_count != 0));
+      trace.blocked = blocked;
+   }
+}
@@ -0,0 +1,233 @@
+#include "storage.h"
+#include "bulk.h"
+#include "utils.h"
+
+#include <set>
+#include <array>
+
+#include <boost/range/adaptor/transformed.hpp>
+
+namespace ba = boost::adaptors;
+using boost::optional;
+
+namespace knossos
+{
+   namespace
+   {
+      struct section_t : position_t
+      {
+         section_t( position_t const & pos )
+            : position_t(pos)
+            , neigbours{{}}
+         {}
+
+         section_t( int x = 0, int y = 0 )
+            : section_t(position_t(x, y))
+         {}
+
+         typedef
+            std::array<section_t const *, direction_t::total_num>
+            neigbours_t;
+
+         mutable neigbours_t neigbours;
+      };
+
+      struct section_compare_t
+      {
+         using is_transparent = void;
+
+         bool operator() (section_t const &ls, section_t const &rs) const
+         {
+            return ls.x < rs.x || (ls.x == rs.x && ls.y < rs.y);
+         }
+      };
+
+      /// Хранение секций в упорядоченном дереве с указателями на соседей
+      struct tree_storage_t : storage_base_t<tree_storage_t>
+      {
+         std::unique_ptr<storage_t> clone() const override
+         {
+            // Копия дерева указывала бы на соседей в оригинале,
+            // поэтому связи строятся заново; секции уже упорядочены
+            std::unique_ptr<tree_storage_t> copy(new tree_storage_t);
+            std::vector<position_t> positions(sections.begin(), sections.end());
+            copy->insert_bulk(positions, 1);
+            return copy;
+         }
+
+         bool insert(position_t const & pos) override
+         {
+            auto result = sections.emplace(pos);
+            if (!result.second)
+               return false;
+
+            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
+            {
+               if (auto section = find_section(move(pos, dir)))
+               {
+                  result.first->neigbours[dir] = section;
+                  section->neigbours[opposite_direction(dir)] = &(*result.first);
+               }
+            }
+            return true;
+         }
+
+         void insert_bulk(std::vector<position_t> & sorted, unsigned num_threads) override
+         {
+            sort_unique(sorted, num_threads);
+            if (sorted.empty())
+               return;
+
+            // Подсказка - первая прежняя секция за вставляемой, с ней вставка
+            // амортизированно O(1). Она ищется заново, только когда пакет
+            // её перешагнул (в пустое дерево и порциями упорядоченного
+            // файла - никогда)
+            section_compare_t const less{};
+            auto const merge = !sections.empty();
+            auto hint = merge ? sections.lower_bound(sorted.front()) : sections.end();
+
+            std::vector<section_t const *> inserted;
+            std::vector<iterator_t> added;
+            inserted.reserve(sorted.size());
+            for (auto const & pos : sorted)
+            {
+               if (hint != sections.end() && less(*hint, pos))
+                  hint = sections.lower_bound(pos);
+               if (hint != sections.end() && !less(pos, *hint))
+               {
+                  inserted.push_back(&*hint);
+                  continue;
+               }
+
+               auto const itr = sections.emplace_hint(hint, pos);
+               inserted.push_back(&*itr);
+               if (merge)
+                  added.push_back(itr);
+            }
+
+            link_sorted(sorted, num_threads,
+               [&inserted](std::size_t from, std::size_t to, direction_t dir)
+               {
+                  inserted[from]->neigbours[dir] = inserted[to];
+                  inserted[to]->neigbours[opposite_direction(dir)] = inserted[from];
+               });
+
+            // Соседей среди прежних секций ищем только там, где пакет их не дал:
+            // верхний и нижний соседи - соседние узлы дерева
+            for (auto itr : added)
+            {
+               auto const & section = *itr;
+               if (!section.neigbours[dir_up] && std::next(itr) != sections.end())
+                  link_if(section, *std::next(itr), dir_up);
+               if (!section.neigbours[dir_down] && itr != sections.begin())
+                  link_if(section, *std::prev(itr), dir_down);
+               for (auto dir : {dir_left, dir_right})
+                  if (!section.neigbours[dir])
+                     if (auto neigbour = find_section(move(section, dir)))
+                        link(section, *neigbour, dir);
+            }
+         }
+
+         bool erase(position_t const & pos) override
+         {
+            auto itr = sections.find(pos);
+            if (itr == sections.end())
+               return false;
+
+            for (auto dir : {dir_left, dir_right, dir_down, dir_up})
+               if (auto neigbour = itr->neigbours[dir])
+                  neigbour->neigbours[opposite_direction(dir)] = nullptr;
+
+            sections.erase(itr);
+            return true;
+         }
+
+         std::size_t size() const override
+         {
+            return sections.size();
+         }
+
+         positions_range_t positions() const override
+         {
+            return sections | ba::transformed(
+               [](section_t const & section)
+               {
+                  return static_cast<position_t const &>(section);
+               });
+         }
+
+         optional<handle_t> find(position_t const & pos) const override
+         {
+            if (auto section = find_section(pos))
+               return to_handle(section);
+            return boost::none;
+         }
+
+         position_t position(handle_t handle) const override
+         {
+            return *from_handle(handle);
+         }
+
+         typedef section_t const * cursor_t;
+
+         static cursor_t cursor(handle_t handle)
+         {
+            return from_handle(handle);
+         }
+
+         static handle_t handle(cursor_t cursor)
+         {
+            return to_handle(cursor);
+         }
+
+         void step(cursor_t & cursor, direction_t dir) const
+         {
+            if (auto next = cursor->neigbours[dir])
+               cursor = next;
+         }
+
+      private:
+         static handle_t to_handle(section_t const * section)
+         {
+            return reinterpret_cast<std::uintptr_t>(section);
+         }
+
+         static section_t const * from_handle(handle_t handle)
+         {
+            return reinterpret_cast<section_t const *>(std::uintptr_t(handle));
+         }
+
+         typedef std::set<section_t, section_compare_t>::iterator iterator_t;
+
+         static void link(section_t const & from, section_t const & to, direction_t dir)
+         {
+            from.neigbours[dir] = &to;
+            to.neigbours[opposite_direction(dir)] = &from;
+         }
+
+         /// Связывает соседние узлы дерева, если они соседи и на плоскости
+         static void link_if(section_t const & from, section_t const & to, direction_t dir)
+         {
+            auto const pos = move(from, dir);
+            if (pos.x == to.x && pos.y == to.y)
+               link(from, to, dir);
+         }
+
+         section_t const * find_section(position_t const & pos) const
+         {
+            auto itr = sections.find(pos);
+            if (itr == sections.end())
+               return nullptr;
+            return &(*itr);
+         }
+
+      private:
+         std::set<section_t, section_compare_t> sections;
+      };
+   }
+
+   std::unique_ptr<storage_t> make_tree_storage()
+   {
+      return std::unique_ptr<storage_t>(new tree_storage_t);
+   }
+}
@@ -2,15 +2,22 @@
 
 #include <knossos/labyrinth.h>
 
+#include <assert.h>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
 
 namespace knossos
 {
-   direction_t opposite_direction( direction_t dir )
+   inline direction_t opposite_direction( direction_t dir )
    {
       return direction_t((int(dir) + 2) % 4);
    }
 
-   position_t move( position_t const & pos, direction_t dir )
+   inline position_t move( position_t const & pos, direction_t dir )
    {
       position_t res(pos);
       switch (dir)
@@ -26,8 +33,42 @@ namespace knossos
       return res;
    }
 
-   bool operator == ( position_t const & p1, position_t const & p2 )
+   inline bool operator == ( position_t const & p1, position_t const & p2 )
+   {
+      return p1.x == p2.x && p1.y == p2.y;
+   }
+
+   /// Номер младшего установленного бита, word != 0
+   inline int count_trailing_zeros( std::uint64_t word )
+   {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward64(&index, word);
+      return int(index);
+#else
+      return __builtin_ctzll(word);
+#endif
+   }
+
+   /// Количество нулей перед старшим установленным битом, word != 0
+   inline int count_leading_zeros( std::uint64_t word )
+   {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanReverse64(&index, word);
+      return 63 - int(index);
+#else
+      return __builtin_clzll(word);
+#endif
+   }
+
+   /// Количество установленных битов
+   inline int count_bits( std::uint64_t word )
    {
-      return p1.x == p2.x && p2.x == p2.y;
+#ifdef _MSC_VER
+      return int(__popcnt64(word));
+#else
+      return __builtin_popcountll(word);
+#endif
    }
 }
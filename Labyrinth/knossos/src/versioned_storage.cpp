@@ -0,0 +1,227 @@
+#include "bitmap_chunk.h"
+
+#include <atomic>
+
+namespace knossos
+{
+   namespace
+   {
+      int const node_bits = 6;
+      int const node_mask = (1 << node_bits) - 1;
+
+      /// Ключ блока: 26-битные координаты блока в зигзаг-коде вперемешку,
+      /// поэтому у блоков вокруг начала координат ключи маленькие
+      /// и дерево остаётся низким
+      std::uint64_t chunk_key(position_t const & origin)
+      {
+         auto zigzag = [](int v)
+         {
+            return int((std::uint32_t(v) << 1) ^ std::uint32_t(v >> 31));
+         };
+         // morton_code сдвигает координаты на 2^31, xor убирает этот сдвиг
+         return morton_code(position_t(zigzag(origin.x), zigzag(origin.y)))
+            ^ (std::uint64_t(3) << 62);
+      }
+
+      /// Ключи занимают не больше 52 бит, по node_bits на уровень
+      int const max_height = 9;
+
+      /*!
+       * Узел дерева по node_bits бит ключа: mask отмечает существующих
+       * детей, а сами они лежат подряд в порядке номеров. У узлов нижнего
+       * уровня дети - блоки, у остальных - узлы.
+       */
+      struct node_t
+      {
+         std::size_t rank(int index) const
+         {
+            return std::size_t(count_bits(mask & ((std::uint64_t(1) << index) - 1)));
+         }
+
+         bool has(int index) const
+         {
+            return (mask >> index) & 1;
+         }
+
+         std::uint64_t mask = 0;
+         std::vector<std::shared_ptr<node_t>>  children;
+         std::vector<std::shared_ptr<chunk_t>> chunks;
+      };
+
+      /*!
+       * Узел или блок, который можно менять. Общий с другой версией
+       * объект сначала копируется. Если же ссылка единственная, другие
+       * версии его уже отпустили: барьер упорядочивает их прошлые
+       * чтения перед нашими записями.
+       */
+      template <class T>
+      T & own(std::shared_ptr<T> & ptr)
+      {
+         if (ptr.use_count() != 1)
+            ptr = std::make_shared<T>(*ptr);
+         else
+            std::atomic_thread_fence(std::memory_order_acquire);
+         return *ptr;
+      }
+
+      void collect(node_t const & node, int level, chunk_list_t & list)
+      {
+         if (level == 0)
+            for (auto const & chunk : node.chunks)
+               list.push_back(chunk.get());
+         else
+            for (auto const & child : node.children)
+               collect(*child, level - 1, list);
+      }
+
+      /*!
+       * Битовые блоки 64x64 в постоянном префиксном дереве по ключу блока.
+       * Копия хранилища разделяет с оригиналом всё дерево, а изменение
+       * копирует только путь от корня до своего блока (не больше
+       * max_height узлов и один блок), поэтому снимок и правка после
+       * него стоят одинаково на любом размере карты. Разделяемые узлы
+       * никогда не меняются, так что старые версии можно читать из других
+       * потоков одновременно с правкой новой.
+       */
+      struct versioned_storage_t : chunked_storage_t<versioned_storage_t>
+      {
+         versioned_storage_t()
+            : root(std::make_shared<node_t>())
+         {}
+
+         std::unique_ptr<storage_t> clone() const override
+         {
+            return std::unique_ptr<storage_t>(new versioned_storage_t(*this));
+         }
+
+         bool insert(position_t const & pos) override
+         {
+            if (find(pos))
+               return false;
+
+            auto const key = chunk_key(chunk_of(pos));
+            while (key >> (node_bits * height))
+            {
+               // Старый корень становится нулевым ребёнком нового
+               auto top = std::make_shared<node_t>();
+               top->mask = 1;
+               top->children.push_back(std::move(root));
+               root = std::move(top);
+               ++height;
+            }
+
+            auto * node = &own(root);
+            for (int level = height - 1; level != 0; --level)
+            {
+               auto const index = int(key >> (node_bits * level)) & node_mask;
+               auto const rank = node->rank(index);
+               if (!node->has(index))
+               {
+                  node->mask |= std::uint64_t(1) << index;
+                  node->children.insert(node->children.begin() + rank,
+                                        std::make_shared<node_t>());
+               }
+               node = &own(node->children[rank]);
+            }
+
+            auto const index = int(key) & node_mask;
+            auto const rank = node->rank(index);
+            if (!node->has(index))
+            {
+               node->mask |= std::uint64_t(1) << index;
+               node->chunks.insert(node->chunks.begin() + rank,
+                                   std::make_shared<chunk_t>(chunk_of(pos)));
+            }
+
+            auto & chunk = own(node->chunks[rank]);
+            chunk.rows[pos.y & chunk_mask] |= std::uint64_t(1) << (pos.x & chunk_mask);
+            ++chunk.count;
+            ++total;
+            return true;
+         }
+
+         bool erase(position_t const & pos) override
+         {
+            if (!find(pos))
+               return false;
+
+            auto const key = chunk_key(chunk_of(pos));
+            node_t * path[max_height];
+
+            auto * node = &own(root);
+            for (int level = height - 1; level != 0; --level)
+            {
+               path[level] = node;
+               auto const index = int(key >> (node_bits * level)) & node_mask;
+               node = &own(node->children[node->rank(index)]);
+            }
+            path[0] = node;
+
+            auto const index = int(key) & node_mask;
+            auto const rank = node->rank(index);
+            auto & chunk = own(node->chunks[rank]);
+            chunk.rows[pos.y & chunk_mask] &= ~(std::uint64_t(1) << (pos.x & chunk_mask));
+            --total;
+            if (--chunk.count != 0)
+               return true;
+
+            // Пустой блок удаляется вместе с опустевшими узлами над ним
+            node->mask &= ~(std::uint64_t(1) << index);
+            node->chunks.erase(node->chunks.begin() + rank);
+            for (int level = 1; level != height && path[level - 1]->mask == 0; ++level)
+            {
+               auto & parent = *path[level];
+               auto const child = int(key >> (node_bits * level)) & node_mask;
+               parent.children.erase(parent.children.begin() + parent.rank(child));
+               parent.mask &= ~(std::uint64_t(1) << child);
+            }
+            return true;
+         }
+
+         std::size_t size() const override
+         {
+            return total;
+         }
+
+         /// Блоки обходятся в порядке ключей, то есть вдоль кривой Мортона
+         positions_range_t positions() const override
+         {
+            auto list = std::make_shared<chunk_list_t>();
+            collect(*root, height - 1, *list);
+            return chunk_iterator_t<std::shared_ptr<chunk_list_t const>>::range(std::move(list));
+         }
+
+         /// Блок с координатами origin либо nullptr
+         chunk_t const * find_chunk(position_t const & origin) const
+         {
+            auto const key = chunk_key(origin);
+            if (key >> (node_bits * height))
+               return nullptr;
+
+            node_t const * node = root.get();
+            for (int level = height - 1; level != 0; --level)
+            {
+               auto const index = int(key >> (node_bits * level)) & node_mask;
+               if (!node->has(index))
+                  return nullptr;
+               node = node->children[node->rank(index)].get();
+            }
+
+            auto const index = int(key) & node_mask;
+            if (!node->has(index))
+               return nullptr;
+            return node->chunks[node->rank(index)].get();
+         }
+
+      private:
+         std::shared_ptr<node_t> root;
+         int                     height = 1;
+         std::size_t             total  = 0;
+      };
+   }
+
+   std::unique_ptr<storage_t> make_versioned_storage()
+   {
+      return std::unique_ptr<storage_t>(new versioned_storage_t);
+   }
+}
@@ -0,0 +1,19 @@
+# Запуск ariadne в режиме сервера: запросы из файла на стандартный ввод,
+# ответы сравниваются с эталоном
+execute_process(
+   COMMAND ${ARIADNE} --board ${BOARD} --serve
+   INPUT_FILE ${QUERIES}
+   OUTPUT_FILE ${OUTPUT}
+   RESULT_VARIABLE result
+)
+if (NOT result EQUAL 0)
+   message(FATAL_ERROR "ariadne --serve failed: ${result}")
+endif()
+
+execute_process(
+   COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${ETALON}
+   RESULT_VARIABLE result
+)
+if (NOT result EQUAL 0)
+   message(FATAL_ERROR "answers differ from ${ETALON}")
+endif()
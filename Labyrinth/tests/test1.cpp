@@ -3,6 +3,19 @@
 #include <boost/test/unit_test.hpp>
 
 #include <knossos/labyrinth.h>
+#include <knossos/snapshot.h>
+#include <knossos/compiled_route.h>
+#include <knossos/bitboard.h>
+#include <knossos/path_finder.h>
+#include <knossos/agents.h>
+#include <knossos/stats.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
 
 size_t const num_sections = 4;
 static knossos::position_t sections[num_sections] =
@@ -13,6 +26,20 @@ static knossos::position_t sections[num_sections] =
    {1, 1}
 };
 
+static bool same(knossos::position_t const & l, knossos::position_t const & r)
+{
+   return l.x == r.x && l.y == r.y;
+}
+
+static knossos::storage_type_t const storages[] =
+{
+   knossos::storage_tree,
+   knossos::storage_hash,
+   knossos::storage_bitmap,
+   knossos::storage_compact,
+   knossos::storage_versioned
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 BOOST_AUTO_TEST_SUITE(testClassLabyrinth)
@@ -66,6 +93,990 @@ BOOST_AUTO_TEST_CASE(testRoute)
    BOOST_CHECK(pos.x == end_pos.x && pos.y == end_pos.y);
 }
 
+BOOST_AUTO_TEST_CASE(testStorages)
+{
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(sections, knossos::position_t{0, 0}, storage);
+      BOOST_CHECK(lab.storage() == storage);
+      BOOST_CHECK(num_sections == boost::size(lab.sections()));
+
+      knossos::direction_t route[] = {knossos::dir_right,
+                                      knossos::dir_up,
+                                      knossos::dir_left,
+                                      knossos::dir_down,
+                                      knossos::dir_down};
+      auto pos = lab.navigate(route);
+      BOOST_CHECK(pos.x == 0 && pos.y == 0);
+
+      knossos::position_t const removed[] = {{0, 1}};
+      lab.remove_sections(removed);
+      BOOST_CHECK(lab.is_position_set());
+      BOOST_CHECK(num_sections - 1 == boost::size(lab.sections()));
+
+      knossos::direction_t route2[] = {knossos::dir_up,
+                                       knossos::dir_right,
+                                       knossos::dir_up,
+                                       knossos::dir_left};
+      pos = lab.navigate(route2);
+      BOOST_CHECK(pos.x == 1 && pos.y == 1);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testStorageNegativeCoordinates)
+{
+   // Крест через начало координат, пересекающий границы блоков
+   std::vector<knossos::position_t> cross;
+   for (int i = -100; i <= 100; ++i)
+   {
+      cross.emplace_back(i, -1);
+      if (i != -1)
+         cross.emplace_back(-1, i);
+   }
+
+   auto less = [](knossos::position_t const & l, knossos::position_t const & r)
+   {
+      return l.x < r.x || (l.x == r.x && l.y < r.y);
+   };
+   std::sort(cross.begin(), cross.end(), less);
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(cross, knossos::position_t{-100, -1}, storage);
+      lab.optimize();
+      BOOST_CHECK(lab.position().x == -100 && lab.position().y == -1);
+
+      std::vector<knossos::position_t> stored(lab.sections().begin(), lab.sections().end());
+      std::sort(stored.begin(), stored.end(), less);
+      BOOST_CHECK(stored.size() == cross.size());
+      BOOST_CHECK(std::equal(stored.begin(), stored.end(), cross.begin(),
+         [](knossos::position_t const & l, knossos::position_t const & r)
+         {
+            return l.x == r.x && l.y == r.y;
+         }));
+
+      std::vector<knossos::direction_t> route(300, knossos::dir_right);
+      route.insert(route.end(), 101, knossos::dir_left);
+      route.insert(route.end(), 300, knossos::dir_down);
+      auto pos = lab.navigate(route);
+      BOOST_CHECK(pos.x == -1 && pos.y == -100);
+
+      knossos::position_t const removed[] = {{-1, -50}};
+      lab.remove_sections(removed);
+      std::vector<knossos::direction_t> up(300, knossos::dir_up);
+      pos = lab.navigate(up);
+      BOOST_CHECK(pos.x == -1 && pos.y == -51);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testStorageMassRemove)
+{
+   std::vector<knossos::position_t> line, tail;
+   for (int x = 0; x < 3000; ++x)
+      (x < 1000 ? line : tail).emplace_back(x, 0);
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(line, knossos::position_t{500, 0}, storage);
+      lab.add_sections(tail);
+
+      // Удаляется больше секций, чем остаётся: хранилище может уплотниться
+      lab.remove_sections(tail);
+      BOOST_CHECK(line.size() == boost::size(lab.sections()));
+      BOOST_CHECK(lab.position().x == 500);
+
+      std::vector<knossos::direction_t> route(5000, knossos::dir_right);
+      BOOST_CHECK(lab.navigate(route).x == 999);
+
+      lab.add_sections(boost::make_iterator_range(tail.begin(), tail.begin() + 500));
+      BOOST_CHECK(lab.navigate(route).x == 1499);
+      route.assign(5000, knossos::dir_left);
+      BOOST_CHECK(lab.navigate(route).x == 0);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testBulkSections)
+{
+   // Квадрат 300x300 с дырами, в обратном порядке и с повторами
+   std::vector<knossos::position_t> board;
+   for (int x = 299; x >= 0; --x)
+      for (int y = 299; y >= 0; --y)
+         if ((x * 7 + y * 13) % 5 != 0)
+            board.emplace_back(x - 150, y - 150);
+   auto const unique_count = board.size();
+   board.insert(board.end(), board.begin(), board.begin() + 1000);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i < 3000; ++i)
+      route.push_back(knossos::direction_t((i * i + i / 7) % knossos::total_num));
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t reference(storage);
+      reference.add_sections(board);
+      auto const expected = reference.navigate(route, board.front());
+
+      for (unsigned threads : {1u, 4u})
+      {
+         knossos::labyrinth_t lab(storage);
+         lab.add_sections(std::vector<knossos::position_t>(board), threads);
+         BOOST_CHECK(unique_count == boost::size(lab.sections()));
+
+         auto const pos = lab.navigate(route, board.front());
+         BOOST_CHECK(pos.x == expected.x && pos.y == expected.y);
+      }
+
+      // Порциями в непустой лабиринт: связи с прежними секциями
+      // находятся так же, как при добавлении всего сразу
+      knossos::labyrinth_t chunked(storage);
+      for (std::size_t first = 0; first < board.size(); first += 7001)
+      {
+         auto const last = std::min(board.size(), first + 7001);
+         chunked.add_sections(std::vector<knossos::position_t>(&board[first], &board[0] + last), 2);
+      }
+      BOOST_CHECK(unique_count == boost::size(chunked.sections()));
+      auto const pos = chunked.navigate(route, board.front());
+      BOOST_CHECK(pos.x == expected.x && pos.y == expected.y);
+
+      for (std::size_t i = 0; i < unique_count; i += 37)
+         for (unsigned dir = 0; dir != knossos::total_num; ++dir)
+         {
+            knossos::direction_t const step[] = {knossos::direction_t(dir)};
+            BOOST_CHECK(same(chunked.navigate(step, board[i]), reference.navigate(step, board[i])));
+         }
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testRouteBuffers)
+{
+   knossos::position_t const start_pos{0, 0};
+   knossos::labyrinth_t lab;
+   lab.add_sections(sections, sections + num_sections);
+   BOOST_CHECK(num_sections == boost::size(lab.sections()));
+
+   knossos::direction_t const route[] = {knossos::dir_right,
+                                         knossos::dir_up,
+                                         knossos::dir_left};
+   BOOST_CHECK_THROW(lab.navigate(route, route + 3), knossos::position_error_t);
+
+   auto pos = lab.navigate(route, route + 3, start_pos);
+   BOOST_CHECK(pos.x == 0 && pos.y == 1);
+
+   std::uint8_t const codes[] = {knossos::dir_down, knossos::dir_right, knossos::dir_down};
+   pos = lab.navigate(codes, 3);
+   BOOST_CHECK(pos.x == 1 && pos.y == 0);
+
+   std::uint8_t const invalid[] = {knossos::dir_up, 4};
+   BOOST_CHECK_THROW(lab.navigate(invalid, 2), knossos::route_error_t);
+   BOOST_CHECK(lab.position().x == 1 && lab.position().y == 0);
+}
+
+BOOST_AUTO_TEST_CASE(testRouteRuns)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = -40; x < 40; ++x)
+      for (int y = -40; y < 40; ++y)
+         if ((x * 3 + y * y) % 11 != 0 || y == 1)
+            board.emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i < 300; ++i)
+      route.insert(route.end(), (i * 37) % 50, knossos::direction_t((i * 7 + i / 5) % knossos::total_num));
+   auto runs = knossos::encode_runs(route.data(), route.data() + route.size());
+   BOOST_CHECK(runs.size() < route.size() / 10);
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, boost::none, storage);
+      auto const expected = lab.navigate(route.data(), route.data() + route.size(), board[0]);
+      auto const end = lab.navigate(runs.data(), runs.data() + runs.size(), board[0]);
+      BOOST_CHECK(end.x == expected.x && end.y == expected.y);
+
+      // Участок длиннее любого коридора и индекс после изменения карты
+      knossos::route_run_t const far[] = {{knossos::dir_left, ~std::uint64_t(0)}};
+      BOOST_CHECK(lab.navigate(far, far + 1, knossos::position_t(39, 1)).x == -40);
+      knossos::position_t const wall(0, 1);
+      lab.remove_sections(boost::make_iterator_range(&wall, &wall + 1));
+      BOOST_CHECK(lab.navigate(far, far + 1, knossos::position_t(39, 1)).x == 1);
+
+      knossos::cursor_t cursor(lab.snapshot(), knossos::position_t(-1, 1));
+      BOOST_CHECK(cursor.navigate(far, far + 1).x == -40);
+
+      knossos::route_run_t const invalid[] = {{knossos::dir_up, 1},
+                                              {knossos::direction_t(7), 1}};
+      BOOST_CHECK_THROW(lab.navigate(invalid, invalid + 2), knossos::route_error_t);
+      BOOST_CHECK(lab.position().x == 1 && lab.position().y == 1);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testFindRoute)
+{
+   // Змейка: стены через столбец с проходом попеременно сверху и снизу
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 21; ++x)
+      for (int y = 0; y < 10; ++y)
+         if (x % 2 == 0 || y == (x % 4 == 1 ? 9 : 0))
+            board.emplace_back(x, y);
+   board.emplace_back(30, 0);
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, knossos::position_t(0, 0), storage);
+      std::vector<knossos::direction_t> bfs, astar;
+      BOOST_CHECK(lab.find_route(knossos::position_t(20, 5), bfs, boost::none, knossos::search_bfs));
+      BOOST_CHECK(lab.find_route(knossos::position_t(20, 5), astar));
+      BOOST_CHECK(bfs.size() == 5 * 20 + 10 + 5);
+      BOOST_CHECK(astar.size() == bfs.size());
+      BOOST_CHECK(lab.position().x == 0 && lab.position().y == 0);
+
+      BOOST_CHECK(same(lab.navigate(bfs), knossos::position_t(20, 5)));
+      BOOST_CHECK(same(lab.navigate(astar, knossos::position_t(0, 0)), knossos::position_t(20, 5)));
+
+      BOOST_CHECK(!lab.find_route(knossos::position_t(30, 0), bfs));
+      BOOST_CHECK(bfs.empty());
+      BOOST_CHECK(!lab.find_route(knossos::position_t(1, 1), astar));
+      BOOST_CHECK(astar.empty());
+      BOOST_CHECK(lab.find_route(knossos::position_t(20, 5), bfs, knossos::position_t(20, 5)));
+      BOOST_CHECK(bfs.empty());
+   }
+
+   knossos::labyrinth_t lab(board);
+   std::vector<knossos::direction_t> route;
+   BOOST_CHECK_THROW(lab.find_route(knossos::position_t(0, 0), route), knossos::position_error_t);
+
+   // Повторные запросы через снимок тем же объектом поиска
+   knossos::path_finder_t finder;
+   auto const map = lab.snapshot();
+   for (int y = 0; y < 10; ++y)
+   {
+      BOOST_CHECK(finder.find_route(map, knossos::position_t(0, y), knossos::position_t(2, y), route));
+      BOOST_CHECK(route.size() == std::size_t(2 + 2 * (9 - y)));
+   }
+   BOOST_CHECK(finder.visited() > 0);
+
+   // Короткие и длинные запросы вперемешку: после длинного очищаются
+   // только его ячейки, и следующие поиски не видят его следов
+   for (int i = 0; i != 3; ++i)
+   {
+      BOOST_CHECK(finder.find_route(map, knossos::position_t(0, 0), knossos::position_t(20, 5), route));
+      BOOST_CHECK(route.size() == 5 * 20 + 10 + 5);
+      BOOST_CHECK(finder.find_route(map, knossos::position_t(0, 0), knossos::position_t(0, 1), route,
+                                    knossos::search_bfs));
+      BOOST_CHECK(route.size() == 1);
+      BOOST_CHECK(finder.visited() < 10);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testReachable)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 40; ++x)
+      for (int y = 0; y < 40; ++y)
+         board.emplace_back(x, y);
+
+   knossos::labyrinth_t lab(board, boost::none, knossos::storage_hash);
+   knossos::position_t const a(0, 0), b(39, 39);
+   BOOST_CHECK(lab.is_reachable(a, b));
+   BOOST_CHECK(!lab.is_reachable(a, knossos::position_t(40, 0)));
+
+   // Стена по столбцу разделяет компоненту, проход в ней снова объединяет
+   std::vector<knossos::position_t> wall;
+   for (int y = 0; y < 40; ++y)
+      wall.emplace_back(20, y);
+   lab.remove_sections(wall);
+   BOOST_CHECK(!lab.is_reachable(a, b));
+   BOOST_CHECK(lab.is_reachable(a, knossos::position_t(19, 39)));
+   lab.add_sections(&wall[7], &wall[8]);
+   BOOST_CHECK(lab.is_reachable(a, b));
+
+   // Случайные изменения сверяются с поиском маршрута, в том числе
+   // после перестройки индекса при большом числе удалений
+   unsigned seed = 12345;
+   auto random = [&seed](unsigned n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+   std::vector<knossos::direction_t> route;
+   for (int round = 0; round != 30; ++round)
+   {
+      std::vector<knossos::position_t> changed;
+      for (int i = 0; i != 60; ++i)
+         changed.push_back(board[random(unsigned(board.size()))]);
+      if (round % 3 == 2)
+         lab.add_sections(std::vector<knossos::position_t>(changed));
+      else
+         lab.remove_sections(changed);
+
+      for (int i = 0; i != 20; ++i)
+      {
+         auto const from = board[random(unsigned(board.size()))];
+         auto const to   = board[random(unsigned(board.size()))];
+         BOOST_CHECK(lab.is_reachable(from, to)
+                     == lab.find_route(to, route, from, knossos::search_bfs));
+      }
+   }
+
+   // Остаётся одна строка: удалённых больше, чем секций, индекс перестраивается
+   lab.add_sections(std::vector<knossos::position_t>(board));
+   BOOST_CHECK(lab.is_reachable(a, b));
+   std::vector<knossos::position_t> rest;
+   for (auto const & pos : board)
+      if (pos.y != 0)
+         rest.push_back(pos);
+   lab.remove_sections(rest);
+   BOOST_CHECK(lab.is_reachable(a, knossos::position_t(39, 0)));
+   BOOST_CHECK(!lab.is_reachable(a, b));
+   lab.add_sections(&board[1], &board[2]);
+   BOOST_CHECK(lab.is_reachable(knossos::position_t(0, 1), knossos::position_t(39, 0)));
+}
+
+BOOST_AUTO_TEST_CASE(testRegionQueries)
+{
+   unsigned seed = 777;
+   auto random = [&seed](unsigned n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+
+   std::vector<knossos::position_t> board;
+   for (int x = -30; x < 30; ++x)
+      for (int y = -30; y < 30; ++y)
+         if (random(3) != 0)
+            board.emplace_back(x, y);
+
+   auto inside = [](knossos::position_t const & pos, knossos::region_t const & region)
+   {
+      return pos.x >= region.low.x && pos.x <= region.high.x
+          && pos.y >= region.low.y && pos.y <= region.high.y;
+   };
+   auto near = [](knossos::position_t const & pos, knossos::position_t const & center, int radius)
+   {
+      auto const dx = pos.x - center.x, dy = pos.y - center.y;
+      return dx * dx + dy * dy <= radius * radius;
+   };
+
+   knossos::labyrinth_t lab(board, boost::none, knossos::storage_bitmap);
+   std::vector<knossos::position_t> found;
+   for (int i = 0; i != 50; ++i)
+   {
+      knossos::position_t const low(int(random(80)) - 40, int(random(80)) - 40);
+      knossos::region_t const region{low, knossos::position_t(low.x + int(random(30)),
+                                                              low.y + int(random(30)))};
+      lab.sections_in(region, found);
+      std::size_t expected = 0;
+      for (auto const & pos : board)
+         expected += inside(pos, region);
+      BOOST_CHECK(found.size() == expected);
+      BOOST_CHECK(lab.count_in(region) == expected);
+      for (std::size_t j = 0; j != found.size(); ++j)
+      {
+         BOOST_CHECK(inside(found[j], region) && lab.snapshot().contains(found[j]));
+         if (j != 0)
+            BOOST_CHECK(found[j - 1].y < found[j].y
+                        || (found[j - 1].y == found[j].y && found[j - 1].x < found[j].x));
+      }
+
+      auto const radius = int(random(25));
+      lab.sections_within(low, std::uint32_t(radius), found);
+      expected = 0;
+      for (auto const & pos : board)
+         expected += near(pos, low, radius);
+      BOOST_CHECK(found.size() == expected);
+      BOOST_CHECK(lab.count_within(low, std::uint32_t(radius)) == expected);
+      for (auto const & pos : found)
+         BOOST_CHECK(near(pos, low, radius));
+   }
+
+   // Индекс сбрасывается при изменении, снимок отвечает по своей версии
+   auto const map = lab.snapshot();
+   knossos::region_t const all{knossos::position_t(-100, -100), knossos::position_t(100, 100)};
+   lab.remove_sections(std::vector<knossos::position_t>(board.begin(), board.begin() + 10));
+   BOOST_CHECK(lab.count_in(all) == board.size() - 10);
+   BOOST_CHECK(map.count_in(all) == board.size());
+   BOOST_CHECK(map.count_within(knossos::position_t(0, 0), 0xffffffffu) == board.size());
+   BOOST_CHECK(lab.count_in(knossos::region_t{all.high, all.low}) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(testTracedNavigate)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 40; ++x)
+      for (int y = 0; y < 40; ++y)
+         if ((x * 7 + y * 3) % 5 != 0)
+            board.emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i != 3000; ++i)
+      route.push_back(knossos::direction_t((i / (1 + i % 7)) % knossos::total_num));
+
+   knossos::route_trace_t trace;
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, board[0], storage);
+
+      // Эталон: путь по одному шагу
+      std::vector<knossos::position_t> path;
+      std::uint64_t blocked = 0;
+      for (auto dir : route)
+      {
+         auto const before = lab.position();
+         lab.navigate(&dir, &dir + 1);
+         if (same(before, lab.position()))
+            ++blocked;
+         else
+            path.push_back(lab.position());
+      }
+
+      auto const end = lab.navigate(route.data(), route.data() + route.size(), trace, board[0]);
+      BOOST_CHECK(same(end, path.back()));
+      BOOST_CHECK(trace.blocked == blocked);
+
+      std::vector<knossos::position_t> traced;
+      for (auto const & run : trace.runs)
+      {
+         auto pos = run.start;
+         BOOST_CHECK(same(pos, traced.empty() ? board[0] : traced.back()));
+         for (std::uint64_t i = 0; i != run.count; ++i)
+         {
+            pos.x += run.dir == knossos::dir_right ? 1 : run.dir == knossos::dir_left ? -1 : 0;
+            pos.y += run.dir == knossos::dir_up ? 1 : run.dir == knossos::dir_down ? -1 : 0;
+            traced.push_back(pos);
+         }
+      }
+      BOOST_CHECK(traced.size() == path.size());
+      BOOST_CHECK(std::equal(traced.begin(), traced.end(), path.begin(), same));
+      BOOST_CHECK(trace.runs.size() < path.size());
+
+      // Курсор снимка пишет тот же путь, в стену - пустой путь
+      knossos::cursor_t cursor(lab.snapshot());
+      knossos::route_trace_t copy;
+      cursor.navigate(route.data(), route.data() + route.size(), copy, board[0]);
+      BOOST_CHECK(copy.runs.size() == trace.runs.size() && copy.blocked == trace.blocked);
+
+      knossos::direction_t const wall[] = {knossos::dir_down, knossos::dir_left};
+      lab.navigate(wall, wall + 2, trace, board[0]);
+      BOOST_CHECK(trace.runs.empty() && trace.blocked == 2);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testNavigateBatch)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 64; ++x)
+      for (int y = 0; y < 64; ++y)
+         if ((x ^ y) % 3 != 0)
+            board.emplace_back(x, y);
+
+   std::vector<std::vector<knossos::direction_t>> routes(1000);
+   std::vector<knossos::route_query_t> queries;
+   for (std::size_t i = 0; i != routes.size(); ++i)
+   {
+      for (std::size_t step = 0; step != i % 97; ++step)
+         routes[i].push_back(knossos::direction_t((i * 31 + step * step) % knossos::total_num));
+      queries.push_back({board[i * 7 % board.size()], routes[i].data(), routes[i].size()});
+   }
+   queries.push_back({knossos::position_t{0, 0}, routes[1].data(), routes[1].size()});
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, boost::none, storage);
+
+      std::vector<boost::optional<knossos::position_t>> results;
+      lab.navigate_batch(queries, results, 4);
+      BOOST_REQUIRE(results.size() == queries.size());
+      BOOST_CHECK(!lab.is_position_set());
+      BOOST_CHECK(!results.back());
+
+      for (std::size_t i = 0; i != routes.size(); ++i)
+      {
+         auto const & expected = lab.navigate(routes[i], queries[i].start);
+         BOOST_CHECK(results[i] && results[i]->x == expected.x && results[i]->y == expected.y);
+      }
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+///////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(testClassSnapshot)
+
+BOOST_AUTO_TEST_CASE(testSnapshotIsolation)
+{
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(sections, knossos::position_t{0, 0}, storage);
+      auto const snapshot = lab.snapshot();
+
+      lab.remove_sections(boost::make_iterator_range(sections, sections + 2));
+      BOOST_CHECK(boost::size(lab.sections()) == num_sections - 2);
+      BOOST_CHECK(snapshot.size() == num_sections);
+      BOOST_CHECK(snapshot.contains(sections[0]));
+      BOOST_CHECK(!lab.set_position(sections[0]));
+
+      knossos::cursor_t cursor(snapshot, sections[0]);
+      knossos::direction_t const route[] = {knossos::dir_up, knossos::dir_right};
+      auto pos = cursor.navigate(route, route + 2);
+      BOOST_CHECK(pos.x == 1 && pos.y == 1);
+
+      BOOST_CHECK_THROW(knossos::cursor_t(snapshot, knossos::position_t{5, 5}),
+                        knossos::position_error_t);
+      knossos::cursor_t unset(snapshot);
+      BOOST_CHECK(!unset.is_position_set());
+      BOOST_CHECK_THROW(unset.navigate(route, route + 2), knossos::position_error_t);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testConcurrentCursors)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 100; ++x)
+      for (int y = 0; y < 100; ++y)
+         if ((x * y) % 7 != 3)
+            board.emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i < 20000; ++i)
+      route.push_back(knossos::direction_t((i * 7 + i / 13) % knossos::total_num));
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, boost::none, storage);
+      auto const expected = lab.navigate(route, board[0]);
+      auto const snapshot = lab.snapshot();
+
+      std::vector<knossos::position_t> ends(4);
+      std::vector<std::thread> threads;
+      for (std::size_t i = 0; i != ends.size(); ++i)
+         threads.emplace_back([&, i]
+         {
+            knossos::cursor_t cursor(snapshot, board[0]);
+            ends[i] = cursor.navigate(route.data(), route.data() + route.size());
+         });
+
+      // Изменения лабиринта не видны читателям снимка
+      lab.remove_sections(boost::make_iterator_range(board.begin() + 1, board.end()));
+      for (auto & thread : threads)
+         thread.join();
+
+      for (auto const & end : ends)
+         BOOST_CHECK(end.x == expected.x && end.y == expected.y);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testVersions)
+{
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(storage);
+      BOOST_CHECK(lab.version() == 0);
+      BOOST_CHECK(lab.published().size() == 0);
+
+      lab.add_sections(sections);
+      auto const first = lab.snapshot();
+      lab.publish();
+      BOOST_CHECK(first.version() == lab.version());
+
+      std::vector<knossos::position_t> far{{-1000, 70}, {-1000, 71}, {5000, -9000}};
+      lab.add_sections(far);
+      lab.remove_sections(boost::make_iterator_range(sections, sections + 1));
+      BOOST_CHECK(lab.version() == first.version() + 2);
+
+      // Прежние версии не видят правок
+      BOOST_CHECK(first.size() == num_sections);
+      BOOST_CHECK(first.contains(sections[0]));
+      BOOST_CHECK(!first.contains(far[0]));
+      BOOST_CHECK(lab.published().version() == first.version());
+      BOOST_CHECK(lab.published().size() == num_sections);
+
+      auto const second = lab.snapshot();
+      BOOST_CHECK(second.size() == num_sections - 1 + far.size());
+      knossos::cursor_t cursor(second, far[0]);
+      knossos::direction_t const route[] = {knossos::dir_up, knossos::dir_up};
+      BOOST_CHECK(cursor.navigate(route, route + 2).y == 71);
+
+      lab.remove_sections(far);
+      BOOST_CHECK(second.contains(far[2]));
+      BOOST_CHECK(!lab.snapshot().contains(far[2]));
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testPublishWhileReading)
+{
+   // Каждая версия добавляет одну секцию, так что размер любой
+   // опубликованной версии равен её номеру
+   std::uint64_t const edits = 2000;
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(storage);
+
+      std::vector<std::thread> readers;
+      std::vector<int> errors(3);
+      for (std::size_t i = 0; i != errors.size(); ++i)
+         readers.emplace_back([&, i]
+         {
+            for (std::uint64_t version = 0; version != edits;)
+            {
+               auto const map = lab.published();
+               if (map.size() != map.version() || map.version() < version)
+                  ++errors[i];
+               version = map.version();
+               if (version != 0)
+               {
+                  knossos::cursor_t cursor(map, knossos::position_t(0, 0));
+                  auto const end = cursor.navigate(
+                     std::vector<knossos::direction_t>(edits, knossos::dir_right));
+                  if (end.x != int(version) - 1)
+                     ++errors[i];
+               }
+            }
+         });
+
+      for (int x = 0; x != int(edits); ++x)
+      {
+         knossos::position_t const section(x, 0);
+         lab.add_sections(boost::make_iterator_range(&section, &section + 1));
+         lab.publish();
+      }
+      for (auto & reader : readers)
+         reader.join();
+
+      for (auto count : errors)
+         BOOST_CHECK(count == 0);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testCompiledRoute)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = 0; x < 50; ++x)
+      for (int y = 0; y < 50; ++y)
+         if ((x * 5 + y * 3) % 7 != 0)
+            board.emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i < 400; ++i)
+      route.push_back(knossos::direction_t((i * i + i / 3) % knossos::total_num));
+   auto const runs = knossos::encode_runs(route.data(), route.data() + route.size());
+
+   for (auto storage : storages)
+   {
+      knossos::labyrinth_t lab(board, boost::none, storage);
+      auto const map = lab.snapshot();
+      knossos::compiled_route_t const compiled(map, route.data(), route.data() + route.size());
+      knossos::compiled_route_t const from_runs(map, runs.data(), runs.data() + runs.size());
+      auto const squared = compiled.then(compiled);
+      auto const cubed = compiled.power(3);
+
+      for (std::size_t i = 0; i < board.size(); i += 13)
+      {
+         knossos::cursor_t cursor(map, board[i]);
+         auto const once = cursor.navigate(route.data(), route.data() + route.size());
+         BOOST_CHECK(same(*compiled.apply(board[i]), once));
+         BOOST_CHECK(same(*from_runs.apply(board[i]), once));
+
+         auto const two = cursor.navigate(route.data(), route.data() + route.size());
+         BOOST_CHECK(same(*squared.apply(board[i]), two));
+         BOOST_CHECK(same(*compiled.apply(board[i], 2), two));
+         auto const three = cursor.navigate(route.data(), route.data() + route.size());
+         BOOST_CHECK(same(*cubed.apply(board[i]), three));
+         BOOST_CHECK(same(*compiled.apply(board[i], 3), three));
+
+         // Дальше цикла: положение повторяется через cycle.length применений
+         std::uint64_t const many = 1000000000000ull;
+         auto const cycle = *compiled.cycle(board[i]);
+         BOOST_CHECK(cycle.length >= 1);
+         auto const reduced = cycle.tail + (many - cycle.tail) % cycle.length;
+         BOOST_CHECK(same(*compiled.apply(board[i], many), *compiled.apply(board[i], reduced)));
+         BOOST_CHECK(same(*compiled.apply(board[i], cycle.tail),
+                          *compiled.apply(board[i], cycle.tail + cycle.length)));
+      }
+
+      BOOST_CHECK(!compiled.apply(knossos::position_t(-1, -1)));
+      BOOST_CHECK(!compiled.cycle(knossos::position_t(0, 0)));
+      BOOST_CHECK(same(*compiled.apply(board[0], 0), board[0]));
+      knossos::compiled_route_t const empty(map, route.data(), route.data());
+      BOOST_CHECK(same(*compiled.then(empty).apply(board[0]), *compiled.apply(board[0])));
+
+      // После изменения лабиринта его снимок - уже другая карта
+      lab.add_sections(boost::make_iterator_range(board.begin(), board.begin() + 1));
+      knossos::compiled_route_t const other(lab.snapshot(), route.data(), route.data());
+      BOOST_CHECK_THROW(compiled.then(other), std::invalid_argument);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(testBitboard)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = -70; x < 80; ++x)
+      for (int y = -5; y < 30; ++y)
+         if ((x * x + y * 7) % 9 != 0)
+            board.emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i < 200; ++i)
+      route.push_back(knossos::direction_t((i * 5 + i / 7) % knossos::total_num));
+   auto const route_end = route.data() + route.size();
+
+   knossos::labyrinth_t lab(board);
+   knossos::bitboard_t const bits(lab.snapshot());
+   BOOST_CHECK(bits.origin().x == -70 && bits.origin().y == -5);
+   BOOST_CHECK(bits.width() == 150 && bits.height() == 35);
+
+   std::vector<knossos::position_t> starts, ends;
+   bits.mapping(route.data(), route_end, starts, ends);
+   BOOST_CHECK(starts.size() == board.size());
+
+   auto const less = [](knossos::position_t const & l, knossos::position_t const & r)
+   {
+      return l.y < r.y || (l.y == r.y && l.x < r.x);
+   };
+   std::vector<knossos::position_t> expected;
+   for (std::size_t i = 0; i != starts.size(); ++i)
+   {
+      auto const end = lab.navigate(route.data(), route_end, starts[i]);
+      BOOST_CHECK(same(ends[i], end));
+      expected.push_back(end);
+   }
+   std::sort(expected.begin(), expected.end(), less);
+   expected.erase(std::unique(expected.begin(), expected.end(), same), expected.end());
+
+   auto const occupied = bits.occupied(route.data(), route_end);
+   BOOST_CHECK(occupied.size() == expected.size());
+   BOOST_CHECK(std::equal(occupied.begin(), occupied.end(), expected.begin(), same));
+
+   // Из каких секций маршрут приводит к выбранной
+   std::vector<knossos::position_t> const targets{expected[expected.size() / 2],
+                                                  knossos::position_t(1000, 1000)};
+   auto const reaching = bits.reaching(targets, route.data(), route_end);
+   std::size_t count = 0;
+   for (std::size_t i = 0; i != starts.size(); ++i)
+      if (same(ends[i], targets[0]))
+      {
+         BOOST_CHECK(std::binary_search(reaching.begin(), reaching.end(), starts[i], less));
+         ++count;
+      }
+   BOOST_CHECK(count == reaching.size() && count != 0);
+
+   auto const from = bits.occupied(reaching, route.data(), route_end);
+   BOOST_CHECK(from.size() == 1 && same(from[0], targets[0]));
+
+   knossos::bitboard_t const empty{knossos::snapshot_t()};
+   BOOST_CHECK(empty.occupied(route.data(), route_end).empty());
+}
+
+BOOST_AUTO_TEST_CASE(testAgents)
+{
+   std::vector<knossos::position_t> board;
+   for (int x = -20; x < 20; ++x)
+      for (int y = -20; y < 20; ++y)
+         if ((x * 5 + y * 3) % 7 != 0)
+            board.emplace_back(x, y);
+
+   knossos::labyrinth_t lab(board);
+   auto const map = lab.snapshot();
+
+   // Маршруты разной длины, в том числе пустые, и число агентов,
+   // не кратное ширине векторного шага
+   std::vector<std::vector<knossos::direction_t>> routes(1003);
+   knossos::agents_t agents(map, 4);
+   for (std::size_t i = 0; i != routes.size(); ++i)
+   {
+      for (std::size_t step = 0; step != i % 41 * 3; ++step)
+         routes[i].push_back(knossos::direction_t((i + step * step / 3) % knossos::total_num));
+      auto const id = agents.add(board[i * 13 % board.size()],
+                                 routes[i].data(), routes[i].data() + routes[i].size());
+      BOOST_CHECK(id == i);
+   }
+   BOOST_CHECK(agents.size() == routes.size());
+   BOOST_CHECK(agents.active() < routes.size());
+
+   auto expect = [&](std::size_t agent, std::size_t ticks)
+   {
+      knossos::cursor_t cursor(map, board[agent * 13 % board.size()]);
+      auto const steps = std::min(ticks, routes[agent].size());
+      return cursor.navigate(routes[agent].data(), routes[agent].data() + steps);
+   };
+
+   std::size_t ticks = 0;
+   std::vector<knossos::position_t> positions;
+   for (std::uint64_t advance : {0, 1, 7, 50, 1000})
+   {
+      auto const active = agents.advance(advance);
+      ticks += std::size_t(advance);
+      agents.positions(positions);
+
+      std::size_t expected_active = 0;
+      for (std::size_t i = 0; i != routes.size(); ++i)
+      {
+         BOOST_CHECK(same(positions[i], expect(i, ticks)));
+         BOOST_CHECK(same(agents.position(i), positions[i]));
+         auto const left = routes[i].size() - std::min(ticks, routes[i].size());
+         BOOST_CHECK(agents.remaining(i) == left);
+         expected_active += left != 0;
+      }
+      BOOST_CHECK(active == expected_active);
+      BOOST_CHECK(agents.active() == active);
+   }
+   BOOST_CHECK(agents.active() == 0);
+
+   knossos::direction_t const bad[] = {knossos::dir_up, knossos::direction_t(7)};
+   BOOST_CHECK_THROW(agents.add(knossos::position_t(100, 100), bad, bad + 1), knossos::position_error_t);
+   BOOST_CHECK_THROW(agents.add(board[0], bad, bad + 2), knossos::route_error_t);
+   BOOST_CHECK(agents.size() == routes.size());
+
+   // Маршрут последнего агента кончается раньше остальных: векторный шаг
+   // продолжает читать код по его курсору, стоящему в конце массива кодов
+   knossos::agents_t tail(map, 1);
+   std::vector<knossos::direction_t> const long_route(30, knossos::dir_right);
+   for (std::size_t i = 0; i != 15; ++i)
+      tail.add(board[i], long_route.data(), long_route.data() + long_route.size());
+   tail.add(board[15], long_route.data(), long_route.data() + 1);
+   BOOST_CHECK(tail.advance(10) == 15);
+   BOOST_CHECK(tail.advance(100) == 0);
+   knossos::cursor_t last(map, board[15]);
+   BOOST_CHECK(same(tail.position(15), last.navigate(long_route.data(), long_route.data() + 1)));
+}
+
+BOOST_AUTO_TEST_CASE(testStateFile)
+{
+   std::vector<knossos::position_t> board, removed;
+   for (int x = -30; x < 30; ++x)
+      for (int y = -30; y < 30; ++y)
+         ((x * 7 + y * 3) % 5 != 0 ? board : removed).emplace_back(x, y);
+
+   std::vector<knossos::direction_t> route;
+   for (int i = 0; i != 500; ++i)
+      route.push_back(knossos::direction_t((i * i / 7) % knossos::total_num));
+
+   auto sorted = [](knossos::positions_range_t range)
+   {
+      std::vector<std::pair<int, int>> result;
+      for (auto const & pos : range)
+         result.emplace_back(pos.x, pos.y);
+      std::sort(result.begin(), result.end());
+      return result;
+   };
+
+   std::string const path = "test_state.knossos";
+   for (auto storage : storages)
+   {
+      // Удалённые секции оставляют в compact надгробия, они тоже сохраняются
+      knossos::labyrinth_t lab(storage);
+      lab.add_sections(std::vector<knossos::position_t>(board));
+      lab.add_sections(std::vector<knossos::position_t>(removed));
+      lab.remove_sections(removed);
+      lab.set_position(board[17]);
+      lab.save(path);
+
+      knossos::labyrinth_t loaded(knossos::storage_tree);
+      auto const version = loaded.version();
+      loaded.load(path);
+      BOOST_CHECK(loaded.storage() == storage);
+      BOOST_CHECK(loaded.version() > version);
+      BOOST_CHECK(loaded.is_position_set() && same(loaded.position(), board[17]));
+      BOOST_CHECK(sorted(loaded.sections()) == sorted(lab.sections()));
+      BOOST_CHECK(same(loaded.navigate(route.data(), route.data() + route.size()),
+                       lab.navigate(route.data(), route.data() + route.size())));
+
+      // Загруженная карта изменяется как обычная
+      loaded.add_sections(std::vector<knossos::position_t>(removed));
+      BOOST_CHECK(boost::size(loaded.sections()) == board.size() + removed.size());
+   }
+
+   knossos::labyrinth_t empty;
+   empty.save(path);
+   knossos::labyrinth_t lab(board, board[0], knossos::storage_compact);
+   lab.load(path);
+   BOOST_CHECK(!lab.is_position_set() && boost::empty(lab.sections()));
+
+   // Порча файла обнаруживается, лабиринт при этом не меняется
+   lab.add_sections(std::vector<knossos::position_t>(board));
+   lab.save(path);
+   std::string contents;
+   {
+      std::ifstream file(path.c_str(), std::ios::binary);
+      contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+   }
+   auto write = [&path](std::string const & data)
+   {
+      std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+      file.write(data.data(), std::streamsize(data.size()));
+   };
+
+   auto flipped = contents;
+   flipped[contents.size() / 2] ^= 0x10;
+   auto other_version = contents;
+   other_version[12] ^= 0x7f;
+
+   for (auto const & data : {flipped, other_version, contents.substr(0, contents.size() - 8),
+                             contents.substr(0, 20), std::string()})
+   {
+      write(data);
+      BOOST_CHECK_THROW(lab.load(path), knossos::state_error_t);
+      BOOST_CHECK(boost::size(lab.sections()) == board.size());
+   }
+
+   // Номер соседа за пределами массива при верной контрольной сумме:
+   // первое слово соседей первой секции compact (заголовок 48 байт, число
+   // секций 8 байт, координаты 8 байт), сумма пересчитывается так же,
+   // как в файле - словами по 8 байт в четырёх цепочках
+   knossos::labyrinth_t(board, board[0], knossos::storage_compact).save(path);
+   std::string bad_neighbour;
+   {
+      std::ifstream file(path.c_str(), std::ios::binary);
+      bad_neighbour.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+   }
+   BOOST_CHECK_NO_THROW(knossos::labyrinth_t().load(path));
+   std::uint32_t const bad_index = 0xfffffff0u;
+   std::memcpy(&bad_neighbour[64], &bad_index, sizeof(bad_index));
+   std::uint64_t const multiplier = 0x9e3779b97f4a7c15ULL;
+   std::uint64_t lanes[4] = {1, 2, 3, 4}, count = 0;
+   for (std::size_t offset = 48; offset < bad_neighbour.size(); offset += 8, ++count)
+   {
+      std::uint64_t word;
+      std::memcpy(&word, &bad_neighbour[offset], sizeof(word));
+      auto & lane = lanes[count & 3];
+      lane = (lane ^ word ^ (lane >> 29)) * multiplier;
+   }
+   for (auto lane : lanes)
+      count = (count ^ lane ^ (lane >> 31)) * multiplier;
+   std::memcpy(&bad_neighbour[40], &count, sizeof(count));
+
+   write(bad_neighbour);
+   BOOST_CHECK_THROW(lab.load(path), knossos::state_error_t);
+   BOOST_CHECK(boost::size(lab.sections()) == board.size());
+
+   std::remove(path.c_str());
+   BOOST_CHECK_THROW(lab.load(path), knossos::state_error_t);
+}
+
+BOOST_AUTO_TEST_CASE(testStats)
+{
+   // Без WITH_STATS счётчики не ведутся и остаются нулями
+   knossos::reset_stats();
+   knossos::labyrinth_t lab(sections);
+   lab.add_sections(std::vector<knossos::position_t>{{0, 0}, {2, 0}}, 0);
+   lab.remove_sections(std::vector<knossos::position_t>{{2, 0}, {5, 5}});
+
+   BOOST_CHECK(lab.set_position(sections[0]));
+   std::vector<knossos::direction_t> const route =
+      {knossos::dir_right, knossos::dir_right, knossos::dir_up, knossos::dir_left};
+   lab.navigate(route);
+
+   // Поиск маршрута проверяет соседей, но навигацией не считается
+   std::vector<knossos::direction_t> found;
+   BOOST_CHECK(lab.find_route(sections[3], found));
+
+   auto const stats = knossos::stats();
+   bool const on = stats.enabled;
+   BOOST_CHECK_EQUAL(stats.sections_inserted, on ? 5u : 0u);
+   BOOST_CHECK_EQUAL(stats.duplicates_skipped, on ? 1u : 0u);
+   BOOST_CHECK_EQUAL(stats.sections_removed, on ? 1u : 0u);
+   BOOST_CHECK_EQUAL(stats.lookups, on ? 1u : 0u);
+   BOOST_CHECK_EQUAL(stats.steps_taken, on ? 3u : 0u);
+   BOOST_CHECK_EQUAL(stats.steps_blocked, on ? 1u : 0u);
+   BOOST_CHECK(on || stats.seconds[knossos::phase_build] == 0);
+
+   knossos::reset_stats();
+   BOOST_CHECK_EQUAL(knossos::stats().steps_taken, 0u);
+   BOOST_CHECK_EQUAL(std::string(knossos::phase_name(knossos::phase_navigate)), "navigate");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 ///////////////////////////////////////////////////////////////////////////////